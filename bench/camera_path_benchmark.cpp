@@ -0,0 +1,71 @@
+// Measures CameraPath against the number of points: the cost of an edit
+// (the arc-length table is baked again), the cost of a lookup by distance,
+// and how far consecutive lookups are from moving at constant speed.
+//
+//   ./camera_path_benchmark
+
+#include <GL/glew.h>
+#include "icg_helper.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <chrono>
+#include <cstdio>
+#include "config.h"
+#include "camera/path/camera_path.h"
+
+using namespace std::chrono;
+
+/* Runs f until at least min_time seconds are spent and returns the nanoseconds per call. */
+template<typename F>
+static double nsPerCall(F f, double min_time = 0.2) {
+    size_t calls = 0;
+    size_t batch = 1;
+    steady_clock::time_point start = steady_clock::now();
+    double elapsed = 0;
+    while (elapsed < min_time) {
+        for (size_t i = 0; i < batch; i++) {
+            f(calls + i);
+        }
+        calls += batch;
+        batch *= 2;
+        elapsed = duration<double>(steady_clock::now() - start).count();
+    }
+    return elapsed * 1e9 / calls;
+}
+
+static glm::vec3 point(size_t i) {
+    return glm::vec3(10.f * std::sin(i * 1.3f), 10.f * std::cos(i * 0.7f), 2.f * i);
+}
+
+int main() {
+    const size_t max_points = 256;
+    /* About what the camera travels in a tick. */
+    const float step = 0.25f;
+    volatile float sink = 0;
+
+    printf("%8s %14s %14s %16s\n", "points", "edit us", "lookup ns", "speed error %");
+    for (size_t count = 4; count <= max_points; count *= 2) {
+        CameraPath path;
+        for (size_t i = 0; i < count; i++) {
+            path.addPoint(point(i));
+        }
+
+        /* Equal steps in distance should give equal steps in space, up to the chord error. */
+        size_t samples = (size_t) (path.Length() / step);
+        float max_error = 0.f;
+        glm::vec3 previous = path.getPositionAtDistance(0.f);
+        for (size_t i = 1; i <= samples; i++) {
+            glm::vec3 position = path.getPositionAtDistance(i * step);
+            max_error = std::max(max_error, std::abs(glm::length(position - previous) - step) / step);
+            previous = position;
+        }
+
+        double edit = nsPerCall([&](size_t i) {
+            path.enableLoop(i % 2 == 0);
+        });
+        double lookup = nsPerCall([&](size_t i) {
+            sink = sink + path.getPositionAtDistance((i % samples) * step).x;
+        });
+        printf("%8zu %14.1f %14.1f %16.2f\n", count, edit / 1e3, lookup, 100.f * max_error);
+    }
+    return 0;
+}
@@ -5,9 +5,10 @@
 #include "icg_helper.h"
 #include "../physics/material_point.h"
 #include "../terrain/terrain.h"
-#include "bezier/bezier_curve.h"
+#include "path/camera_path.h"
 #include <glm/gtc/type_ptr.hpp>
 #include <cstdint>
+#include "../misc/profiling/cpu_profiler.h"
 
 typedef enum DIRECTION {
     Forward = 0, Backward = 1, Left = 2, Right = 3, Up = 4, Down = 5
@@ -23,6 +24,9 @@ public:
 
     Camera(glm::vec3 &starting_position, glm::vec2 &starting_rotation, Terrain *terrain) : MaterialPoint(0.4f, starting_position) {
         m_rotation = glm::vec2(starting_rotation.x, starting_rotation.y);
+        m_previous_rotation = m_rotation;
+        m_render_rotation = m_rotation;
+        m_render_position = m_position;
         m_matrix = IDENTITY_MATRIX;
         m_pressed[Forward] = false;
         m_pressed[Backward] = false;
@@ -34,23 +38,44 @@ public:
         m_mode = CAMERA_MODE::Flythrough;
         m_pos_curve = NULL;
         m_look_curve = NULL;
-        m_bezier_step = TICK;
+        m_path_speed = 0.05f;
         m_rotation_inertia = glm::vec3(0, 0, 0);
+        m_snap = false;
     }
 
+    /* The view matrix is built from the interpolated (render) state, see Interpolate(). */
     void CalculateMatrix() {
         m_matrix = IDENTITY_MATRIX;
-        m_matrix = glm::rotate(m_matrix, glm::radians(m_rotation.y), glm::vec3(1.0f, 0.0f, 0.0f));
-        m_matrix = glm::rotate(m_matrix, glm::radians(m_rotation.x), glm::vec3(0.0f, 1.0f, 0.0f));
-        m_matrix = glm::translate(m_matrix, getPosition());
+        m_matrix = glm::rotate(m_matrix, glm::radians(m_render_rotation.y), glm::vec3(1.0f, 0.0f, 0.0f));
+        m_matrix = glm::rotate(m_matrix, glm::radians(m_render_rotation.x), glm::vec3(0.0f, 1.0f, 0.0f));
+        m_matrix = glm::translate(m_matrix, m_render_position);
+    }
+
+    void savePreviousState() {
+        MaterialPoint::savePreviousState();
+        m_previous_rotation = m_rotation;
+    }
+
+    /* Blends the two last simulated states for rendering, alpha in [0, 1].
+     * The angles turn the short way, a yaw going from 179 to -179 turns by 2 degrees. */
+    void Interpolate(float alpha) {
+        m_render_position = getInterpolatedPosition(alpha);
+        glm::vec2 turn = m_rotation - m_previous_rotation;
+        m_render_rotation = m_previous_rotation + glm::vec2(_wrap180(turn.x), _wrap180(turn.y)) * alpha;
+        CalculateMatrix();
+    }
+
+    /* Position used for rendering this frame. */
+    glm::vec3 getRenderPosition() {
+        return m_render_position;
     }
 
     void tick() {
+        PROFILE_SCOPE("Camera::tick");
         if (m_mode != CAMERA_MODE::Bezier){
             AddRotation();
             _update_acc();
         }
-        CalculateMatrix();
         if (m_mode != CAMERA_MODE::Bezier)
             MaterialPoint::tick();
         if (m_mode == CAMERA_MODE::Fps){
@@ -63,15 +88,37 @@ public:
             catch (std::runtime_error e){
                 /* Fall back mode : FlyThrough */
                 m_mode = CAMERA_MODE::Flythrough;
+                m_snap = true;
             }
         }
         else if (m_mode == CAMERA_MODE::Bezier) {
-            m_bezier_time += m_bezier_step;
-            glm::vec3 look_point = -m_look_curve->getPosition(m_bezier_time);
-            glm::vec3 pos_point = -m_pos_curve->getPosition(m_bezier_time);
+            /* Constant speed along the position path, the look path is followed at the same fraction. */
+            float length = m_pos_curve->Length();
+            m_path_distance += m_path_speed;
+            if (length > 0.f && m_path_distance > length) {
+                m_path_distance = fmod(m_path_distance, length);
+                /* Back at the start of the path, jump there. */
+                m_snap = true;
+            }
+            float fraction = length > 0.f ? m_path_distance / length : 0.f;
+            glm::vec3 look_point = -m_look_curve->getPositionAtFraction(fraction);
+            glm::vec3 pos_point = -m_pos_curve->getPositionAtDistance(m_path_distance);
             m_position = pos_point * TERRAIN_SCALE;
             lookAtPoint(glm::vec3(TERRAIN_SCALE * look_point.x, TERRAIN_SCALE * look_point.y, TERRAIN_SCALE * look_point.z));
         }
+        if (m_snap) {
+            m_snap = false;
+            _resetPreviousState();
+        }
+    }
+
+    /* Where the camera should be in the given time : along its path in Bezier mode,
+     * at its current speed otherwise. */
+    glm::vec3 predictPosition(float seconds) {
+        float ticks = seconds / TICK;
+        if (m_mode == CAMERA_MODE::Bezier && m_pos_curve != NULL && m_pos_curve->Size() > 1)
+            return -m_pos_curve->getPositionAtDistance(m_path_distance + m_path_speed * ticks) * TERRAIN_SCALE;
+        return m_position + m_speed * ticks;
     }
 
     glm::mat4 &GetMatrix() {
@@ -80,9 +127,9 @@ public:
 
     glm::mat4 getMirroredMatrix(float axisHeight) {
         glm::mat4 mirrored = IDENTITY_MATRIX;
-        glm::vec3 pos = getPosition();
-        mirrored = glm::rotate(mirrored, glm::radians(-m_rotation.y), glm::vec3(1.0f, 0.0f, 0.0f));
-        mirrored = glm::rotate(mirrored, glm::radians(m_rotation.x), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::vec3 pos = m_render_position;
+        mirrored = glm::rotate(mirrored, glm::radians(-m_render_rotation.y), glm::vec3(1.0f, 0.0f, 0.0f));
+        mirrored = glm::rotate(mirrored, glm::radians(m_render_rotation.x), glm::vec3(0.0f, 1.0f, 0.0f));
         glm::vec3 new_pos = glm::vec3(pos.x, (axisHeight - (pos.y - axisHeight)), pos.z);
         mirrored = glm::translate(mirrored, new_pos);
         return mirrored;
@@ -157,19 +204,23 @@ public:
         m_pressed[dir] = false;
     }
 
+    /* The position or the angles of a new mode jump, the tick after a change is not interpolated. */
     void enableFpsMode(){
         m_mode = CAMERA_MODE::Fps;
+        m_snap = true;
     }
 
     void enableFlyThroughtMode(){
         m_mode = CAMERA_MODE::Flythrough;
+        m_snap = true;
     }
 
-    void enableBezierMode(BezierCurve *pos_curve, BezierCurve *look_curve){
+    void enableBezierMode(CameraPath *pos_curve, CameraPath *look_curve){
         m_mode = CAMERA_MODE::Bezier;
         m_pos_curve = pos_curve;
         m_look_curve = look_curve;
-        m_bezier_time = 0.f;
+        m_path_distance = 0.f;
+        m_snap = true;
     }
 
     CAMERA_MODE getCameraMode() {
@@ -177,43 +228,73 @@ public:
     }
 
     void AddRotationFPS(glm::vec2 rot) {
-        if (m_mode == CAMERA_MODE::Fps)
+        if (m_mode == CAMERA_MODE::Fps) {
+            /* Mouse look is applied immediately, not interpolated. */
             m_rotation += rot;
+            m_previous_rotation += rot;
+        }
     }
 
     void setPosition(glm::vec3 pos) {
         m_position = pos;
     }
 
+    glm::vec2 getRotation() {
+        return m_rotation;
+    }
+
+    /* Teleports the camera, nothing is interpolated from the previous state. */
+    void setState(glm::vec3 position, glm::vec2 rotation) {
+        m_position = position;
+        m_rotation = rotation;
+        _resetPreviousState();
+    }
+
     glm::vec3 getFrontPoint(float dist = 1.f) {
         return m_position +  getForwardDirection();
     }
 
-    float getBezierStep() {
-        return m_bezier_step;
+    /* Speed along the camera path, in terrain units per tick. */
+    float getPathSpeed() {
+        return m_path_speed;
     }
 
-    void setBezierStep(float step) {
-        m_bezier_step = step;
-        if (m_bezier_step < m_bezier_step_threshold)
-            m_bezier_step = m_bezier_step_threshold;
+    void setPathSpeed(float speed) {
+        m_path_speed = speed;
+        if (m_path_speed < m_path_speed_threshold)
+            m_path_speed = m_path_speed_threshold;
     }
 
 private:
     glm::vec2 m_rotation;
+    glm::vec2 m_previous_rotation;
+    glm::vec2 m_render_rotation;
+    glm::vec3 m_render_position;
     glm::mat4 m_matrix;
     bool m_pressed[6];
-    BezierCurve *m_look_curve;
-    BezierCurve *m_pos_curve;
-    double m_bezier_time;
+    CameraPath *m_look_curve;
+    CameraPath *m_pos_curve;
+    float m_path_distance;
     float const m_rotation_speed = 4.f;
-    float m_bezier_step;
-    const float m_bezier_step_threshold = 0.001f;
+    float m_path_speed;
+    const float m_path_speed_threshold = 0.001f;
     glm::vec3 m_rotation_inertia;
     const float m_rotation_inertia_factor = 0.125f;
 
     Terrain *m_terrain;
     CAMERA_MODE m_mode;
+    /* Set when the next tick jumps, the previous state is then reset instead of interpolated from. */
+    bool m_snap;
+
+    void _resetPreviousState() {
+        m_previous_position = m_position;
+        m_previous_rotation = m_rotation;
+    }
+
+    /* Angle in [-180, 180). */
+    static float _wrap180(float degrees) {
+        return degrees - 360.f * floor((degrees + 180.f) / 360.f);
+    }
 
     glm::vec3 getForwardDirection() {
         float rot_y = m_rotation.y;
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+#include "../../../external/glm/detail/type_vec.hpp"
+#include "../../misc/gl_state/gl_state.h"
+#include "../../misc/shaders/shader_library.h"
+#include "../../misc/profiling/gpu_memory.h"
+
+/* Number of arc-length samples per spline segment. */
+#define CAMERA_PATH_SAMPLES_PER_SEGMENT 32
+
+/* Camera path going through all its points (uniform Catmull-Rom segments).
+ * Each edit bakes a lookup table of the cumulative arc length at regularly
+ * spaced parameters, so that finding the point at a given distance along the
+ * path is a binary search : the camera can then move at constant speed.
+ * The same samples are used as the GPU polyline, which is updated in place. */
+class CameraPath {
+public:
+    void addPoint(glm::vec3 point){
+        m_points.push_back(point);
+        _bake();
+    }
+
+    void enableLoop(bool enable){
+        m_loop = enable;
+        _bake();
+    }
+
+    bool isLooping(){
+        return m_loop;
+    }
+
+    void Clear(){
+        m_points.clear();
+        _bake();
+    }
+
+    size_t Size() {
+        return m_points.size();
+    }
+
+    /* Total arc length of the path. */
+    float Length() {
+        return m_lut_distance.empty() ? 0.f : m_lut_distance.back();
+    }
+
+    /* Point at the given arc length. Wraps around when looping, clamped otherwise. */
+    glm::vec3 getPositionAtDistance(float distance){
+        if (m_points.size() < 2)
+            return m_points.empty() ? glm::vec3(0, 0, 0) : m_points[0];
+        float length = Length();
+        if (m_loop && length > 0.f){
+            distance = std::fmod(distance, length);
+            if (distance < 0.f)
+                distance += length;
+        }
+        distance = glm::clamp(distance, 0.f, length);
+
+        size_t k = std::upper_bound(m_lut_distance.begin(), m_lut_distance.end(), distance) - m_lut_distance.begin();
+        k = glm::clamp(k, (size_t) 1, m_lut_distance.size() - 1);
+        float d0 = m_lut_distance[k - 1];
+        float d1 = m_lut_distance[k];
+        float local = d1 > d0 ? (distance - d0) / (d1 - d0) : 0.f;
+        float param = (k - 1 + local) / CAMERA_PATH_SAMPLES_PER_SEGMENT;
+        return _evaluate(param);
+    }
+
+    /* Point at the given fraction of the total length, in [0, 1]. */
+    glm::vec3 getPositionAtFraction(float fraction){
+        return getPositionAtDistance(fraction * Length());
+    }
+
+    bool Save(std::ostream &out){
+        out << m_loop << " " << m_points.size() << "\n";
+        for (size_t i = 0 ; i < m_points.size() ; i ++){
+            out << m_points[i].x << " " << m_points[i].y << " " << m_points[i].z << "\n";
+        }
+        return (bool) out;
+    }
+
+    /* Reads what Save() wrote without touching any path, see setPoints(). */
+    static bool Read(std::istream &in, std::vector<glm::vec3> &points, bool &loop){
+        size_t count;
+        if (!(in >> loop >> count))
+            return false;
+        points.resize(count);
+        for (size_t i = 0 ; i < count ; i ++){
+            if (!(in >> points[i].x >> points[i].y >> points[i].z))
+                return false;
+        }
+        return true;
+    }
+
+    void setPoints(const std::vector<glm::vec3> &points, bool loop){
+        m_points = points;
+        m_loop = loop;
+        _bake();
+    }
+
+    void Init() {
+        m_program_id = SHADER_LIBRARY.Get("bezier_vshader.glsl",
+                                          "bezier_fshader.glsl");
+        if(!m_program_id) {
+            exit(EXIT_FAILURE);
+        }
+
+        GL_STATE.UseProgram(m_program_id);
+        glGenVertexArrays(1, &m_ver_array_id);
+        GL_STATE.BindVertexArray(m_ver_array_id);
+        glGenBuffers(1, &m_buffer_id);
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer_id);
+        m_buffer_capacity = 0;
+
+        GLint posAttrib = glGetAttribLocation(m_program_id, "position");
+        glEnableVertexAttribArray(posAttrib);
+        glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+        GL_STATE.BindVertexArray(0);
+        GL_STATE.UseProgram(0);
+        m_init_done = true;
+        m_dirty = true;
+    }
+
+    void Draw(const glm::mat4& model = IDENTITY_MATRIX,
+              const glm::mat4& view = IDENTITY_MATRIX,
+              const glm::mat4& projection = IDENTITY_MATRIX){
+        if (!m_init_done)
+            return;
+        if (m_dirty)
+            _upload();
+        if (m_vert_count < 2)
+            return;
+        GL_STATE.UseProgram(m_program_id);
+
+        glm::mat4 MVP = projection * view * model;
+        GLint MVP_id = glGetUniformLocation(m_program_id, "MVP");
+        glUniformMatrix4fv(MVP_id, 1, GL_FALSE, value_ptr(MVP));
+
+        GL_STATE.BindVertexArray(m_ver_array_id);
+        GL_STATE.Disable(GL_BLEND);
+        glDrawArrays(GL_LINE_STRIP, 0, m_vert_count);
+    }
+
+    void CleanUp(){
+        GPU_MEMORY.Free(GPU_OBJECT_BUFFER, m_buffer_id);
+        glDeleteBuffers(1, &m_buffer_id);
+        GL_STATE.DeleteVertexArrays(1, &m_ver_array_id);
+        SHADER_LIBRARY.Release(m_program_id);
+        m_init_done = false;
+    }
+
+private:
+    std::vector<glm::vec3> m_points;
+    bool m_loop = false;
+    /* Cumulative arc length at param i / CAMERA_PATH_SAMPLES_PER_SEGMENT. */
+    std::vector<float> m_lut_distance;
+    std::vector<glm::vec3> m_lut_position;
+
+    GLuint m_program_id;
+    GLuint m_ver_array_id;
+    GLuint m_buffer_id;
+    GLuint m_vert_count = 0;
+    size_t m_buffer_capacity = 0;
+    bool m_init_done = false;
+    bool m_dirty = false;
+
+    size_t _segmentCount(){
+        if (m_points.size() < 2)
+            return 0;
+        return m_loop ? m_points.size() : m_points.size() - 1;
+    }
+
+    glm::vec3 _point(int i){
+        int n = (int) m_points.size();
+        if (m_loop)
+            return m_points[((i % n) + n) % n];
+        return m_points[glm::clamp(i, 0, n - 1)];
+    }
+
+    /* param in [0, segment count], the integer part is the segment. */
+    glm::vec3 _evaluate(float param){
+        size_t segments = _segmentCount();
+        int segment = glm::clamp((int) std::floor(param), 0, (int) segments - 1);
+        float t = param - segment;
+        glm::vec3 p0 = _point(segment - 1);
+        glm::vec3 p1 = _point(segment);
+        glm::vec3 p2 = _point(segment + 1);
+        glm::vec3 p3 = _point(segment + 2);
+        float t2 = t * t;
+        float t3 = t2 * t;
+        return 0.5f * ((2.f * p1) + (p2 - p0) * t + (2.f * p0 - 5.f * p1 + 4.f * p2 - p3) * t2 +
+                       (3.f * p1 - p0 - 3.f * p2 + p3) * t3);
+    }
+
+    void _bake(){
+        m_lut_distance.clear();
+        m_lut_position.clear();
+        size_t samples = _segmentCount() * CAMERA_PATH_SAMPLES_PER_SEGMENT;
+        if (samples > 0){
+            glm::vec3 previous = _evaluate(0.f);
+            float distance = 0.f;
+            m_lut_distance.push_back(0.f);
+            m_lut_position.push_back(previous);
+            for (size_t i = 1 ; i <= samples ; i ++){
+                glm::vec3 pos = _evaluate(i / (float) CAMERA_PATH_SAMPLES_PER_SEGMENT);
+                distance += glm::length(pos - previous);
+                m_lut_distance.push_back(distance);
+                m_lut_position.push_back(pos);
+                previous = pos;
+            }
+        }
+        m_dirty = true;
+    }
+
+    void _upload(){
+        std::vector<glm::vec3> vertices(m_lut_position.size());
+        for (size_t i = 0 ; i < vertices.size() ; i ++){
+            vertices[i] = m_lut_position[i] / TERRAIN_SCALE;
+        }
+        m_vert_count = vertices.size();
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer_id);
+        if (vertices.size() > m_buffer_capacity){
+            /* Grow geometrically so that adding points rarely reallocates. */
+            m_buffer_capacity = std::max(vertices.size(), 2 * m_buffer_capacity);
+            glBufferData(GL_ARRAY_BUFFER, m_buffer_capacity * sizeof(glm::vec3), NULL, GL_DYNAMIC_DRAW);
+            GPU_MEMORY.Allocate(GPU_OBJECT_BUFFER, m_buffer_id, GPU_MEMORY_GEOMETRY,
+                                m_buffer_capacity * sizeof(glm::vec3));
+        }
+        if (!vertices.empty())
+            glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(glm::vec3), vertices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        m_dirty = false;
+    }
+};
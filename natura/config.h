@@ -4,16 +4,44 @@
 
 /* Time of a tick in seconds. */
 #define TICK (1.f / 60.f)
+/* Maximum number of ticks simulated in a single frame. When a frame takes longer
+ * than that the simulation slows down instead of spiraling. */
+#define MAX_TICKS_PER_FRAME 5
 /* Scale of the terrain. */
 #define TERRAIN_SCALE 2.0f
-/* Size of the terrain in chunks. */
+/* Default size of the terrain in chunks per side, see --view-distance. */
 #define TERRAIN_CHUNK_SIZE 10
+/* Bounds of the size of the terrain, a GPU memory budget can lower the maximum. */
+#define TERRAIN_CHUNK_SIZE_MIN 4
+#define TERRAIN_CHUNK_SIZE_MAX 40
 /* Height of the water grid. */
 #define WATER_HEIGHT -0.75f
 /* Number of sub-tiles per chunk. */
 #define CHUNK_SIDE_TILE_COUNT 4
+/* File used to save and load the camera paths. */
+#define CAMERA_PATH_FILE "camera_path.txt"
 /* Maximum time a ball can stay in a frozen state. */
 #define BALL_MAX_FROZEN_TIME 30.f
+/* Radius of a ball in terrain units (sphere.obj has radius 0.5, drawn at scale 0.1). */
+#define BALL_RADIUS 0.05f
+/* Height samples per chunk side kept on the CPU for getHeight() and the ray casts.
+ * A power of two plus one, so that the min/max pyramid halves down to a single block. */
+#define HEIGHTFIELD_RESOLUTION 65
+/* Chunks are generated ahead of the positions the camera is predicted to reach within
+ * CHUNK_PREFETCH_HORIZON seconds, sampled CHUNK_PREFETCH_SAMPLES times. */
+#define CHUNK_PREFETCH_HORIZON 2.0f
+#define CHUNK_PREFETCH_SAMPLES 8
+/* Rows of chunks generated in a single frame when the camera is about to leave the terrain. */
+#define CHUNK_PREFETCH_MAX_ROWS 3
+/* Rows of chunks kept generated after they leave the terrain, see ChunkCache. */
+#define CHUNK_CACHE_ROWS 2
+/* Chrome trace written on exit when the game is built with NATURA_PROFILE. */
+#define CPU_PROFILE_FILE "profile_trace.json"
+/* Directory of the compiled program binaries. */
+#define SHADER_CACHE_DIR "shader_cache"
+/* Video memory budget in MB, exceeding it prints a warning. 0 disables it. */
+#define GPU_MEMORY_BUDGET_MB 0
 
 glm::vec2 TERRAIN_OFFSET;
-GLuint grass_program_id;
+/* Framebuffer the final image goes to: 0 for the window, an offscreen FBO in headless mode. */
+GLuint DEFAULT_FRAMEBUFFER = 0;
@@ -1,100 +1,171 @@
 #pragma once
 
 #include "icg_helper.h"
+#include "config.h"
+#include "misc/gl_state/gl_state.h"
+#include "misc/gl_resource/gl_handle.h"
 
 class FrameBuffer {
 
 public:
-    
+
     // warning: overrides viewport!!
     void Bind() {
         glViewport(0, 0, width_, height_);
-        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object_id_);
-        const GLenum buffers[] = {GL_COLOR_ATTACHMENT0};
-        glDrawBuffers(1 /*length of buffers[]*/, buffers);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object_id_.getId());
+        const GLenum buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(secondary_format_ ? 2 : 1 /*length of buffers[]*/, buffers);
     }
 
     void Unbind() {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, DEFAULT_FRAMEBUFFER);
     }
 
-    int Init(int image_width, int image_height, GLint internalFormat,  bool use_interpolation = true) {
+    /* A non-zero secondaryFormat adds a second colour attachment (location = 1) of that format. */
+    int Init(int image_width, int image_height, GLint internalFormat,  bool use_interpolation = true,
+             GpuMemoryCategory category = GPU_MEMORY_OTHER, GLint secondaryFormat = 0) {
         this->width_ = image_width;
         this->height_ = image_height;
-
-        // create color attachment
-        {
-            glGenTextures(1, &color_texture_id_);
-            glBindTexture(GL_TEXTURE_2D, color_texture_id_);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-            if (use_interpolation) {
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            } else {
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            }
-
-            // create texture for the color attachment
-            // see Table.2 on
-            // khronos.org/opengles/sdk/docs/man3/docbook4/xhtml/glTexImage2D.xml
-            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width_, height_, 0,
-                         GL_RGB, GL_UNSIGNED_BYTE, NULL);
-            // how to load from buffer
+        this->internal_format_ = internalFormat;
+        this->secondary_format_ = secondaryFormat;
+        this->use_interpolation_ = use_interpolation;
+        this->category_ = category;
+
+        // create color attachments
+        _createColorTexture(color_texture_id_, internal_format_);
+        if (secondary_format_) {
+            _createColorTexture(secondary_texture_id_, secondary_format_);
         }
 
         // create render buffer (for depth channel)
         {
-            glGenRenderbuffers(1, &depth_render_buffer_id_);
-            glBindRenderbuffer(GL_RENDERBUFFER, depth_render_buffer_id_);
+            glBindRenderbuffer(GL_RENDERBUFFER, depth_render_buffer_id_.Create());
             glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32, width_, height_);
             glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            GPU_MEMORY.Allocate(GPU_OBJECT_RENDERBUFFER, depth_render_buffer_id_.getId(), category_,
+                                GpuMemoryTracker::TextureBytes(GL_DEPTH_COMPONENT32, width_, height_));
         }
 
         // tie it all together
         {
-            glGenFramebuffers(1, &framebuffer_object_id_);
-            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object_id_);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object_id_.Create());
             glFramebufferTexture2D(GL_FRAMEBUFFER,
                                    GL_COLOR_ATTACHMENT0 /*location = 0*/,
-                                   GL_TEXTURE_2D, color_texture_id_,
+                                   GL_TEXTURE_2D, color_texture_id_.getId(),
                                    0 /*level*/);
+            if (secondary_format_) {
+                glFramebufferTexture2D(GL_FRAMEBUFFER,
+                                       GL_COLOR_ATTACHMENT1 /*location = 1*/,
+                                       GL_TEXTURE_2D, secondary_texture_id_.getId(),
+                                       0 /*level*/);
+            }
             glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-                                      GL_RENDERBUFFER, depth_render_buffer_id_);
+                                      GL_RENDERBUFFER, depth_render_buffer_id_.getId());
 
             if (glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
                 GL_FRAMEBUFFER_COMPLETE) {
                 cerr << "!!!ERROR: Framebuffer not OK :(" << endl;
             }
-            glBindFramebuffer(GL_FRAMEBUFFER, 0); // avoid pollution
+            glBindFramebuffer(GL_FRAMEBUFFER, DEFAULT_FRAMEBUFFER); // avoid pollution
         }
 
-        return color_texture_id_;
+        return color_texture_id_.getId();
+    }
+
+    /* Reallocates the attachments at the new size, the texture and framebuffer names do not change. */
+    void Resize(int image_width, int image_height) {
+        if (image_width == width_ && image_height == height_)
+            return;
+        width_ = image_width;
+        height_ = image_height;
+
+        _specifyColorTexture(color_texture_id_, internal_format_);
+        if (secondary_format_) {
+            _specifyColorTexture(secondary_texture_id_, secondary_format_);
+        }
+        GL_STATE.BindTexture(GL_TEXTURE_2D, 0);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, depth_render_buffer_id_.getId());
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32, width_, height_);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        GPU_MEMORY.Allocate(GPU_OBJECT_RENDERBUFFER, depth_render_buffer_id_.getId(), category_,
+                            GpuMemoryTracker::TextureBytes(GL_DEPTH_COMPONENT32, width_, height_));
     }
 
     int getTextureId() {
-        return color_texture_id_;
+        return color_texture_id_.getId();
+    }
+
+    /* 0 without a second attachment. */
+    int getSecondaryTextureId() {
+        return secondary_texture_id_.getId();
     }
 
     glm::vec2 getSize() {
         return glm::vec2(width_, height_);
     }
 
+    GLint getInternalFormat() {
+        return internal_format_;
+    }
+
+    GLint getSecondaryFormat() {
+        return secondary_format_;
+    }
+
+    bool usesInterpolation() {
+        return use_interpolation_;
+    }
+
+    GpuMemoryCategory getMemoryCategory() {
+        return category_;
+    }
+
     void Cleanup() {
-        //glDeleteTextures(1, &color_texture_id_);
-        glDeleteRenderbuffers(1, &depth_render_buffer_id_);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0 /*UNBIND*/);
-        glDeleteFramebuffers(1, &framebuffer_object_id_);
+        glBindFramebuffer(GL_FRAMEBUFFER, DEFAULT_FRAMEBUFFER /*UNBIND*/);
+        framebuffer_object_id_.Reset();
+        depth_render_buffer_id_.Reset();
+        color_texture_id_.Reset();
+        secondary_texture_id_.Reset();
     }
 
 private:
 
     int width_;
     int height_;
-    GLuint framebuffer_object_id_;
-    GLuint depth_render_buffer_id_;
-    GLuint color_texture_id_;
+    FramebufferHandle framebuffer_object_id_;
+    RenderbufferHandle depth_render_buffer_id_;
+    TextureHandle color_texture_id_;
+    TextureHandle secondary_texture_id_;
+    GLint internal_format_;
+    GLint secondary_format_;
+    bool use_interpolation_;
+    GpuMemoryCategory category_;
+
+    void _createColorTexture(TextureHandle &texture, GLint internalFormat) {
+        GL_STATE.BindTexture(GL_TEXTURE_2D, texture.Create());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        if (use_interpolation_) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        } else {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        _specifyColorTexture(texture, internalFormat);
+    }
+
+    void _specifyColorTexture(TextureHandle &texture, GLint internalFormat) {
+        // create texture for the color attachment
+        // see Table.2 on
+        // khronos.org/opengles/sdk/docs/man3/docbook4/xhtml/glTexImage2D.xml
+        GL_STATE.BindTexture(GL_TEXTURE_2D, texture.getId());
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width_, height_, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        GPU_MEMORY.Allocate(GPU_OBJECT_TEXTURE, texture.getId(), category_,
+                            GpuMemoryTracker::TextureBytes(internalFormat, width_, height_));
+    }
 
 };
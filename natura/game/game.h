@@ -7,7 +7,9 @@
 #include "../skybox/skybox.h"
 #include "../terrain/terrain.h"
 #include "../physics/ball.h"
-#include "../misc/observer_subject/messages/keyboard_handler_message.h"
+#include "../physics/spatial_hash.h"
+#include "../misc/event_bus/event_bus.h"
+#include "../misc/event_bus/events.h"
 #include "../misc/io/input/handlers/keyboard/keyboard_handler.h"
 #include "../misc/io/input/handlers/mouse/mouse_button_handler.h"
 #include "../misc/io/input/handlers/mouse/mouse_cursor_handler.h"
@@ -15,89 +17,194 @@
 #include "../config.h"
 #include "../shadows/shadowbuffer.h"
 #include "../shadows/attrib_locations.h"
+#include "../misc/replay/input_recorder.h"
+#include "../misc/replay/input_replayer.h"
+#include "../misc/replay/frame_time_report.h"
+#include "../misc/profiling/gpu_timer.h"
+#include "game_options.h"
 #include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include "../misc/profiling/cpu_profiler.h"
+#include "../misc/gl_state/gl_state.h"
+#include "../render_queue/render_queue.h"
+#include "../misc/shaders/shader_library.h"
 
-class Game : public Observer {
+class Game {
 public:
-    Game(GLFWwindow *window) : m_keyboard_handler(window), m_mouse_button_handler(window),
-                               m_mouse_cursor_handler(window), m_frame_buffer_size_handler(window) {
-        glfwGetWindowSize(window, &m_window_width, &m_window_height);
-
+    Game(GLFWwindow *window, const GameOptions &options = GameOptions()) :
+                               m_options(options), m_keyboard_handler(window), m_mouse_button_handler(window),
+                               m_mouse_cursor_handler(window), m_frame_buffer_size_handler(window),
+                               m_ball_hash(2.f * BALL_RADIUS) {
         m_window = window;
+        m_window_width = options.width;
+        m_window_height = options.height;
+        if (m_window)
+            glfwGetWindowSize(window, &m_window_width, &m_window_height);
+
         m_amplitude = 9.05f;
+        m_quit = false;
+        m_clock_origin = std::chrono::steady_clock::now();
+        m_last_time_frame = _wallTime();
+        m_time = m_last_time_frame;
+        m_frame = 0;
+        m_tick_accumulator = 0.f;
+        m_recorder = NULL;
+        m_replayer = NULL;
 
         Init();
-        glfwGetFramebufferSize(window, &m_window_width, &m_window_height);
-        FrameBufferSizeHandlerMessage m(window, m_window_width, m_window_height);
-        resize_callback(&m);
-        m_look_curve.setTimeLength(10.f);
-        m_pos_curve.setTimeLength(10.f);
+        if (m_window)
+            glfwGetFramebufferSize(window, &m_window_width, &m_window_height);
+        FrameBufferSizeEvent e = {window, m_window_width, m_window_height};
+        resize_callback(e);
+        _applyResize();
         m_draw_curves = false;
         m_loop_curves = false;
+        if (!m_options.camera_path_file.empty()) {
+            loadCurves(m_options.camera_path_file);
+            if (m_look_curve.Size() > 1 && m_pos_curve.Size() > 1)
+                m_camera->enableBezierMode(&m_pos_curve, &m_look_curve);
+        }
     }
 
     ~Game() {
         m_perlinNoise->Cleanup();
         m_terrain->Cleanup();
+        for (size_t i = 0; i < m_balls.size(); i++) {
+            m_balls[i]->CleanUp();
+            delete m_balls[i];
+        }
+        m_balls.clear();
+        BASE_GRASS->Cleanup();
+        delete BASE_GRASS;
+        BASE_TILE->Cleanup();
+        delete BASE_TILE;
+        m_pos_curve.CleanUp();
+        m_look_curve.CleanUp();
+        framebufferFloor.Cleanup();
+        m_shadow_buffer.Cleanup();
+        FRAMEBUFFER_POOL.Cleanup();
+        SHADER_LIBRARY.Cleanup();
+        GPU_TIMER.Cleanup();
+        PROFILE_FLUSH(CPU_PROFILE_FILE);
         delete m_perlinNoise;
+        delete m_recorder;
+        delete m_replayer;
+        /* Everything has been released by now, what is still tracked leaked. */
+        if (GPU_MEMORY.getTotalBytes()) {
+            cerr << "GPU memory not released :" << endl;
+            GPU_MEMORY.Report(cerr);
+        }
     }
 
     void run() {
-        m_keyboard_handler.attach(this);
-        m_mouse_button_handler.attach(this);
-        m_mouse_cursor_handler.attach(this);
-        m_frame_buffer_size_handler.attach(this);
+        m_subscriptions.push_back(EVENT_BUS.Subscribe<KeyEvent>([this](const KeyEvent &e) { keyCallback(e); }));
+        m_subscriptions.push_back(EVENT_BUS.Subscribe<MouseButtonEvent>([this](const MouseButtonEvent &e) { mouseButtonCallback(e); }));
+        m_subscriptions.push_back(EVENT_BUS.Subscribe<MouseCursorEvent>([this](const MouseCursorEvent &e) { mouseCursorCallback(e); }));
+        m_subscriptions.push_back(EVENT_BUS.Subscribe<FrameBufferSizeEvent>([this](const FrameBufferSizeEvent &e) { resize_callback(e); }));
+        m_subscriptions.push_back(EVENT_BUS.Subscribe<BallOutOfBoundsEvent>([this](const BallOutOfBoundsEvent &e) { removeBall(e); }));
+        /* Do not simulate the loading time. */
+        m_last_time_frame = _wallTime();
+        try {
+            if (m_options.isRecording()) {
+                m_recorder = new InputRecorder(m_options.record_file, m_last_time_frame);
+                m_recorder->RecordFrameBufferSize(m_window_width, m_window_height);
+            }
+            if (m_options.isReplaying())
+                m_replayer = new InputReplayer(m_options.replay_file, m_window);
+        } catch (const std::runtime_error &e) {
+            cerr << e.what() << endl;
+            m_options.Usage();
+            exit(EXIT_FAILURE);
+        }
+        if (m_replayer) {
+            m_last_time_frame = m_replayer->StartTime();
+            /* Measure the frames, not the display refresh rate. */
+            if (m_window)
+                glfwSwapInterval(0);
+        }
+        const double start_time = m_last_time_frame;
+        FrameTimeReport report;
+        double frame_start = _wallTime();
         // render loop
-        while (!glfwWindowShouldClose(m_window)) {
-            glm::vec3 pos = m_camera->getPosition();
+        while (!_shouldClose()) {
+            /* The simulation clock, recorded or replayed so that a replay runs the exact same ticks.
+             * Headless runs without a recording advance by exactly one tick per frame. */
+            if (m_replayer)
+                m_time = m_replayer->FrameTime(m_frame);
+            else if (m_options.headless)
+                m_time = start_time + (m_frame + 1) * TICK;
+            else
+                m_time = _wallTime();
+            if (m_recorder)
+                m_recorder->BeginFrame(m_frame, m_time);
+
+            GPU_TIMER.BeginFrame();
+            {
+                GpuTimerScope gpu_scope("frame");
+                Display();
+            }
+            GPU_TIMER.EndFrame();
+            GL_STATE.EndFrame();
+            if (m_window) {
+                glfwSwapBuffers(m_window);
+                glfwPollEvents();
+            }
+            else {
+                /* Nothing to present, wait for the GPU so that the frame time includes its work. */
+                glFinish();
+            }
+            if (m_replayer)
+                m_replayer->PublishEvents(m_frame);
+            /* All the events of the frame (input, balls, noise changes) are handled here. */
+            {
+                PROFILE_SCOPE("EventBus::Dispatch");
+                EVENT_BUS.Dispatch();
+            }
+            _recenterCursor();
 
-            Display();
-            glfwSwapBuffers(m_window);
-            glfwPollEvents();
+            double now = _wallTime();
+            report.AddFrame(now - frame_start);
+            frame_start = now;
+            m_frame++;
         }
-    }
 
-    void update(Message *msg) {
-        switch (msg->getType()) {
-            case Message::Type::KEYBOARD_HANDLER_INPUT :
-                keyCallback(reinterpret_cast<KeyboardHandlerMessage *>(msg));
-                break;
-
-            case Message::Type::MOUSE_BUTTON_INPUT :
-                mouseButtonCallback(
-                        reinterpret_cast<MouseButtonHandlerMessage *>(msg));
-                break;
-
-            case Message::Type::MOUSE_CURSOR_INPUT :
-                mouseCursorCallback(reinterpret_cast<MouseCursorHandlerMessage *>(msg));
-                break;
-
-            case Message::Type::FRAMEBUFFER_SIZE_CHANGE :
-                resize_callback(reinterpret_cast<FrameBufferSizeHandlerMessage *>(msg));
-                break;
-
-            case Message::Type::BALL_OUT_OF_BOUNDS : {
-                BallOutOfBoundsMessage *message = reinterpret_cast<BallOutOfBoundsMessage *> (msg);
-                Ball *ball = message->getBallInstance();
-                ball->CleanUp();
-                std::vector<Ball *>::iterator position = std::find(m_balls.begin(), m_balls.end(), ball);
-                if (position != m_balls.end()) // == myVector.end() means the element was not found
-                    m_balls.erase(position);
-                break;
-            }
-
-            default:
-                throw std::string("Error : Unexpected message in class Game");
+        GPU_TIMER.Report(cout);
+        GL_STATE.Report(cout);
+        SHADER_LIBRARY.Report(cout);
+        PROGRAM_CACHE.Report(cout);
+        FRAMEBUFFER_POOL.Report(cout);
+        m_terrain->Report(cout);
+        GPU_MEMORY.Report(cout);
+        if (m_replayer || m_options.headless) {
+            report.Write(cout);
+            if (report.Write(m_options.report_file))
+                cout << "Frame-time report written to " << m_options.report_file << endl;
+            else
+                cerr << "Could not write the frame-time report to " << m_options.report_file << endl;
         }
     }
 
 private:
-    float m_last_time_tick;
+    GameOptions m_options;
+    /* Set when the game should stop, used when there is no window. */
+    bool m_quit;
+    std::chrono::steady_clock::time_point m_clock_origin;
     float m_last_time_frame;
+    float m_tick_accumulator;
+    /* Simulation clock of the current frame and frame counter. */
+    double m_time;
+    unsigned long m_frame;
+
+    /* Record / replay, only one of them is set at a time. */
+    InputRecorder *m_recorder;
+    InputReplayer *m_replayer;
 
     /* Window size */
     int m_window_width;
     int m_window_height;
+    int m_pending_width;
+    int m_pending_height;
+    bool m_resize_pending = false;
     GLFWwindow *m_window;
 
     /* Camera and view */
@@ -105,6 +212,10 @@ private:
     glm::mat4 m_grid_model_matrix;
     Projection *m_projection;
     float m_fps_sensitivity = 0.1;
+    /* Last cursor position handled, the cursor goes back to the center once per frame. */
+    double m_cursor_x = 0.0;
+    double m_cursor_y = 0.0;
+    bool m_cursor_moved = false;
 
     /* Perlin noise generator for the game. */
     PerlinNoise *m_perlinNoise;
@@ -114,9 +225,9 @@ private:
     float m_amplitude;
 
 
-    /* Bezier Curve for camera */
-    BezierCurve m_pos_curve;
-    BezierCurve m_look_curve;
+    /* Paths followed by the camera in Bezier mode */
+    CameraPath m_pos_curve;
+    CameraPath m_look_curve;
     bool m_draw_curves;
     bool m_loop_curves;
 
@@ -127,12 +238,12 @@ private:
     MouseCursorHandler m_mouse_cursor_handler;
     FrameBufferSizeHandler m_frame_buffer_size_handler;
 
+    /* Rendering of the current frame : the terrain reflected in the water, then the queued draws. */
     FrameBuffer framebufferFloor;
+    RenderQueue m_render_queue;
 
     /* Shadows. */
-    GLuint m_default_pid; /* Default pid. */
     ShadowBuffer m_shadow_buffer;
-    GLuint m_shadow_pid;      // Handle for the shadow map genration shader program
     GLuint m_depth_tex;       // Handle for the shadow map
     glm::vec3 m_light_dir;         // Direction towards the light
     glm::mat4 m_light_projection;  // Projection matrix for light source
@@ -145,30 +256,52 @@ private:
     float m_light_height = 7.f;
 
 
+    /* Event handlers of the game, detached when the game is destroyed. */
+    std::vector<Subscription> m_subscriptions;
+
     vector<Ball *> m_balls;
+    /* Camera positions handed to Terrain::ExpandTerrain(), kept to reuse the storage. */
+    std::vector<glm::vec3> m_predicted_positions;
+    /* Broadphase for ball-ball contacts, rebuilt every tick. */
+    SpatialHash<Ball> m_ball_hash;
 
 
     /* Private function. */
     void Init() {
-        const int TERRAIN_SIZE = TERRAIN_CHUNK_SIZE;
+        PROFILE_SCOPE("Game::Init");
         const int VERT_PER_GRID_SIDE = 8;
-        const float cam_posxy = TERRAIN_SCALE * ((float) (TERRAIN_SIZE * CHUNK_SIDE_TILE_COUNT)) / 2.0f;
 
-        glm::vec3 starting_camera_position = glm::vec3(-cam_posxy, -5.0f, -cam_posxy);
-        glm::vec2 starting_camera_rotation = glm::vec2(-180.0f, 30.0f);
+        PROGRAM_CACHE.setDirectory(m_options.shader_cache_dir == "none" ? "" : m_options.shader_cache_dir);
+        SHADER_LIBRARY.Init();
+        /* Compiled by the driver while the textures load, the grid requests its own variants. */
+        SHADER_LIBRARY.Request("perlin_quad_vshader.glsl", "perlin_quad_fshader.glsl");
+        SHADER_LIBRARY.Request("water_grid_vshader.glsl", "water_grid_fshader.glsl");
+        SHADER_LIBRARY.Request("cube_vshader.glsl", "cube_fshader.glsl");
+        SHADER_LIBRARY.Request("grass_vshader.glsl", "grass_fshader.glsl", "grass_gshader.glsl");
+        SHADER_LIBRARY.Request("bezier_vshader.glsl", "bezier_fshader.glsl");
+        SHADER_LIBRARY.Request("ball_vshader.glsl", "ball_fshader.glsl");
+        GPU_MEMORY.setBudget((size_t) m_options.gpu_budget_mb * 1024 * 1024);
+        GPU_TIMER.Init();
+        if (m_options.isExportingGpuTimes())
+            GPU_TIMER.setCsvFile(m_options.gpu_csv_file);
 
         m_projection = new Projection(45.0f, (GLfloat) m_window_width / m_window_height, 0.025f, 400.0f);
-        m_perlinNoise = new PerlinNoise(m_window_width, m_window_height, glm::vec2(TERRAIN_SIZE, TERRAIN_SIZE));
+        m_perlinNoise = new PerlinNoise(m_window_width, m_window_height);
+
+        m_terrain = new Terrain(m_options.view_distance, VERT_PER_GRID_SIDE, m_perlinNoise);
+        m_projection->setFar(m_terrain->getFarPlane());
 
-        m_terrain = new Terrain(TERRAIN_SIZE, VERT_PER_GRID_SIDE, m_perlinNoise);
+        const float cam_posxy = TERRAIN_SCALE * ((float) (m_terrain->getChunkCount() * CHUNK_SIDE_TILE_COUNT)) / 2.0f;
+        glm::vec3 starting_camera_position = glm::vec3(-cam_posxy, -5.0f, -cam_posxy);
+        glm::vec2 starting_camera_rotation = glm::vec2(-180.0f, 30.0f);
         m_camera = new Camera(starting_camera_position, starting_camera_rotation, m_terrain);
 
         // sets background color b
         glClearColor(0, 0, 0/*gray*/, 1.0 /*solid*/);
 
         // enable depth test.
-        glEnable(GL_DEPTH_TEST);
-        glEnable(GL_MULTISAMPLE);
+        GL_STATE.Enable(GL_DEPTH_TEST);
+        GL_STATE.Enable(GL_MULTISAMPLE);
         m_grid_model_matrix = IDENTITY_MATRIX;
         m_grid_model_matrix = scale(m_grid_model_matrix, glm::vec3(TERRAIN_SCALE, TERRAIN_SCALE, TERRAIN_SCALE));
 
@@ -177,28 +310,19 @@ private:
         BASE_TILE->Init(0);
 
         m_perlinNoise->Init();
-        GLuint fb_tex = framebufferFloor.Init(m_window_width, m_window_height, GL_RGB8);
+        GLuint fb_tex = framebufferFloor.Init(m_window_width, m_window_height, GL_RGB8, true,
+                                                GPU_MEMORY_REFLECTION);
         m_terrain->Init(fb_tex);
 
         BASE_GRASS = new Grass(0.01f, 0.2f, 0.4f);
         BASE_GRASS->Init();
 
+        m_pos_curve.Init();
+        m_look_curve.Init();
+
         m_light_dir = glm::vec3(0.0, m_light_height, 0.0);
 
         m_light_dir = normalize(m_light_dir);
-        m_default_pid = BASE_TILE->getPID();
-        if(!m_default_pid) {
-            exit(EXIT_FAILURE);
-        }
-
-        m_shadow_pid = icg_helper::LoadShaders("shadow_map_vshader.glsl",
-                                             "shadow_map_fshader.glsl");
-        if(!m_shadow_pid) {
-            exit(EXIT_FAILURE);
-        }
-        BASE_TILE->setShadowPID(m_shadow_pid);
-        glBindAttribLocation(m_shadow_pid, ATTRIB_LOC_position, "position");
-        glLinkProgram(m_shadow_pid);
 
         glViewport(0,0,m_window_width,m_window_height);
 
@@ -210,30 +334,43 @@ private:
 
         m_depth_tex = m_shadow_buffer.Init();
         BASE_TILE->setDepthTex(m_depth_tex);
+
+        /* Everything else is allocated now, the budget left decides how many chunks fit. */
+        if (GPU_MEMORY.getBudget())
+            _setViewDistance(m_options.view_distance);
     }
 
     void Display() {
+        PROFILE_SCOPE("Game::Display");
+        _applyResize();
         glViewport(0, 0, m_window_width, m_window_height);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        const float time = glfwGetTime();
+        const float time = m_time;
 
+        /* Fixed timestep: the frame time is accumulated and consumed in TICK sized steps. */
+        m_tick_accumulator += time - m_last_time_frame;
         m_last_time_frame = time;
-
-        //tick 60 times per second
-        if (time - m_last_time_tick >= TICK) {
-            m_last_time_tick = time;
-            m_camera->tick();
-            for (int i = 0; i < m_balls.size(); i++) {
-                m_balls[i]->tick(-m_camera->getPosition());
-            }
+        int ticks = 0;
+        while (m_tick_accumulator >= TICK && ticks < MAX_TICKS_PER_FRAME) {
+            _tick();
+            m_tick_accumulator -= TICK;
+            ticks++;
         }
+        if (m_tick_accumulator >= TICK) {
+            /* Too far behind (hitch, breakpoint, ...), drop the remaining time. */
+            m_tick_accumulator = fmod(m_tick_accumulator, TICK);
+        }
+        _syncCameraState();
+        const float alpha = m_tick_accumulator / TICK;
+        m_camera->Interpolate(alpha);
+        const glm::vec3 cam_pos = m_camera->getRenderPosition();
 
-
-        glm::vec3 tmp = -m_camera->getPosition();
+        glm::vec3 tmp = -cam_pos;
         m_light_dir = glm::vec3(tmp.x+25, m_light_height, tmp.z-25);
 
-        float ext = 60.0f;
+        /* The shadow map covers the terrain. */
+        float ext = 1.5f * m_terrain->getViewRadius();
         m_light_projection = glm::ortho(-ext, ext, -ext, ext, -ext, 2*ext);
         //draw as often as possible
 
@@ -241,121 +378,224 @@ private:
         glm::vec3 up(0.0f, 1.0f, 0.0f);
         glm::mat4 light_view = lookAt(m_light_dir, glm::vec3(tmp.x, 0, tmp.z),
                                  up);
+        BASE_TILE->setShadowOptions(m_show_shadow, m_do_pcf);
         if (m_show_shadow) {
-            glUseProgram(m_shadow_pid);
+            GpuTimerScope gpu_scope("shadow");
             m_shadow_buffer.Bind();
 
+            // Set matrix to transform from world space into NDC and then into [0, 1] ranges.
             glm::mat4 depth_vp = m_light_projection * light_view;
-            glUniformMatrix4fv(glGetUniformLocation(m_shadow_pid, "depth_vp"),
-                               1,
-                               GL_FALSE, value_ptr(depth_vp));
-
+            BASE_TILE->setShadowMatrices(depth_vp, m_offset_matrix * depth_vp, m_light_dir, m_bias);
 
             glClear(GL_DEPTH_BUFFER_BIT);
             BASE_TILE->setUseShadowPID(true);
-            m_terrain->Draw(m_amplitude, time, m_camera->getPosition(), true,
-                            false, m_grid_model_matrix,
-                            light_view,
-                            m_light_projection);
+            m_terrain->Submit(m_render_queue, m_amplitude, time, cam_pos, true, m_grid_model_matrix, light_view);
+            m_render_queue.Flush(_renderContext(time, light_view, m_light_projection), "shadow");
 
             BASE_TILE->setUseShadowPID(false);
             m_shadow_buffer.Unbind();
 
-            glUseProgram(m_default_pid);
-            glUniform3fv(glGetUniformLocation(m_default_pid, "sun_light_dir"),
-                         1,
-                         value_ptr(m_light_dir));
-
-            // Set matrix to transform from world space into NDC and then into [0, 1] ranges.
-            glm::mat4 depth_vp_offset = m_offset_matrix * depth_vp;
-            glUniformMatrix4fv(
-                    glGetUniformLocation(m_default_pid, "depth_vp_offset"), 1,
-                    GL_FALSE, glm::value_ptr(depth_vp_offset));
-
-            glUniform1f(glGetUniformLocation(m_default_pid, "bias"), m_bias);
-
-            glUniform1i(glGetUniformLocation(m_default_pid, "show_shadow"),
-                        m_show_shadow);
-            glUniform1i(glGetUniformLocation(m_default_pid, "do_pcf"),
-                        m_do_pcf);
-
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         }
 
         /* Reflection */
-        glEnable(GL_CLIP_PLANE0);
-        framebufferFloor.Bind();
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        m_terrain->Draw(m_amplitude, time, m_camera->getPosition(), true, true, m_grid_model_matrix,
-                        m_camera->getMirroredMatrix(m_terrain->m_water_height * -CHUNK_SIDE_TILE_COUNT * TERRAIN_SCALE),
-                        m_projection->perspective());
-        framebufferFloor.Unbind();
-        glDisable(GL_CLIP_PLANE0);
+        {
+            GpuTimerScope gpu_scope("reflection");
+            GL_STATE.Enable(GL_CLIP_PLANE0);
+            framebufferFloor.Bind();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glm::mat4 mirrored_view = m_camera->getMirroredMatrix(
+                    m_terrain->m_water_height * -CHUNK_SIDE_TILE_COUNT * TERRAIN_SCALE);
+            m_terrain->Submit(m_render_queue, m_amplitude, time, cam_pos, true, m_grid_model_matrix, mirrored_view);
+            m_render_queue.Flush(_renderContext(time, mirrored_view, m_projection->perspective()), "reflection");
+            framebufferFloor.Unbind();
+            GL_STATE.Disable(GL_CLIP_PLANE0);
+        }
 
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        if (!m_draw_from_light_pov) {
-            m_terrain->Draw(m_amplitude, time, m_camera->getPosition(), false, true, m_grid_model_matrix,
-                            m_camera->GetMatrix(),
-                            m_projection->perspective());
+        {
+            GpuTimerScope gpu_scope("main");
+            glm::mat4 view = m_draw_from_light_pov ? light_view : m_camera->GetMatrix();
+            glm::mat4 projection = m_draw_from_light_pov ? m_light_projection : m_projection->perspective();
+            m_terrain->Submit(m_render_queue, m_amplitude, time, cam_pos, false, m_grid_model_matrix, view);
+            for (int i = 0; i < m_balls.size(); i++) {
+                m_balls[i]->Submit(m_render_queue, m_grid_model_matrix, view, alpha);
+            }
+            m_render_queue.Flush(_renderContext(time, view, projection), "main");
         }
-        else {
-            m_terrain->Draw(m_amplitude, time, m_camera->getPosition(), false, false, m_grid_model_matrix,
-                            light_view,
-                            m_light_projection);
+
+        m_predicted_positions.clear();
+        for (int i = 1; i <= CHUNK_PREFETCH_SAMPLES; i++) {
+            m_predicted_positions.push_back(
+                    m_camera->predictPosition(CHUNK_PREFETCH_HORIZON * i / CHUNK_PREFETCH_SAMPLES));
         }
+        m_terrain->ExpandTerrain(m_camera->getPosition(), m_predicted_positions);
 
-        m_terrain->ExpandTerrain(m_camera->getPosition());
+        if (m_look_curve.Size() > 1 && m_pos_curve.Size() > 1 && m_draw_curves) {
+            GpuTimerScope gpu_scope("curves");
+            m_look_curve.Draw(m_grid_model_matrix, m_camera->GetMatrix(), m_projection->perspective());
+            m_pos_curve.Draw(m_grid_model_matrix, m_camera->GetMatrix(), m_projection->perspective());
+        }
+    }
 
+    RenderContext _renderContext(float time, const glm::mat4 &view, const glm::mat4 &projection) {
+        RenderContext context;
+        context.view = view;
+        context.projection = projection;
+        context.amplitude = m_amplitude;
+        context.time = time;
+        context.water_height = m_terrain->m_water_height * CHUNK_SIDE_TILE_COUNT;
+        context.fog_range = m_terrain->getFogRange();
+        return context;
+    }
 
+    void _setViewDistance(int chunks) {
+        int applied = m_terrain->setChunkCount(chunks);
+        m_projection->setFar(m_terrain->getFarPlane());
+        cout << "View distance : " << applied << " chunks per side" << endl;
+    }
 
+    void _tick() {
+        PROFILE_SCOPE("Game::_tick");
+        m_camera->savePreviousState();
+        m_camera->tick();
         for (int i = 0; i < m_balls.size(); i++) {
-            m_balls[i]->Draw(m_grid_model_matrix, m_camera->GetMatrix(), m_projection->perspective());
+            m_balls[i]->savePreviousState();
+            m_balls[i]->tick(-m_camera->getPosition());
         }
+        _collideBalls();
+    }
 
-        if (m_look_curve.Size() > 1 && m_pos_curve.Size() > 1 && m_draw_curves) {
-            m_look_curve.Draw(m_grid_model_matrix, m_camera->GetMatrix(), m_projection->perspective());
-            m_pos_curve.Draw(m_grid_model_matrix, m_camera->GetMatrix(), m_projection->perspective());
+    /* Seconds since the game was created, glfwGetTime() is not available without a window. */
+    double _wallTime() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_clock_origin).count();
+    }
+
+    bool _shouldClose() {
+        if (m_quit || (m_window && glfwWindowShouldClose(m_window)))
+            return true;
+        if (m_replayer)
+            return m_frame >= m_replayer->FrameCount();
+        return m_options.headless && m_frame >= m_options.headless_frames;
+    }
+
+    /* Records the camera state of the frame, or forces the recorded one during a replay. */
+    void _syncCameraState() {
+        CameraState state;
+        if (m_recorder) {
+            state.position = m_camera->getPosition();
+            state.rotation = m_camera->getRotation();
+            m_recorder->RecordCamera(state);
+        }
+        if (m_replayer && m_replayer->getCameraState(m_frame, state)) {
+            m_camera->setState(state.position, state.rotation);
+        }
+    }
+
+    void _collideBalls() {
+        m_ball_hash.Clear();
+        for (size_t i = 0; i < m_balls.size(); i++) {
+            m_ball_hash.Insert(m_balls[i], m_balls[i]->getPosition(), BALL_RADIUS);
+        }
+        m_ball_hash.Build();
+        m_ball_hash.ForEachPair([](Ball *a, Ball *b) {
+            a->collideWith(*b);
+        });
+    }
+
+    void removeBall(const BallOutOfBoundsEvent &event) {
+        /* A ball can report itself several times before the event is handled. */
+        std::vector<Ball *>::iterator position = std::find(m_balls.begin(), m_balls.end(), event.ball);
+        if (position != m_balls.end()) {
+            (*position)->CleanUp();
+            delete *position;
+            m_balls.erase(position);
         }
     }
 
-    void mouseButtonCallback(MouseButtonHandlerMessage *message) {
-        int button = message->getButton();
-        int action = message->getAction();
-        GLFWwindow *window = message->getWindow();
-        if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+    void mouseButtonCallback(const MouseButtonEvent &event) {
+        int button = event.button;
+        int action = event.action;
+        GLFWwindow *window = event.window;
+        if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && window) {
             double x_i, y_i;
             glfwGetCursorPos(window, &x_i, &y_i);
+            int width, height;
+            glfwGetWindowSize(window, &width, &height);
+            TerrainHit hit;
+            if (_pickTerrain(x_i, y_i, width, height, hit)) {
+                /* Throws a ball at the picked point, as fast as with the P key. */
+                glm::vec3 start = -m_camera->getFrontPoint() / TERRAIN_SCALE;
+                float speed = glm::length(m_camera->getFrontPoint() - m_camera->getPosition());
+                m_balls.push_back(new Ball(start, glm::normalize(hit.position - start) * speed, m_terrain));
+            }
         }
     }
 
-    void mouseCursorCallback(MouseCursorHandlerMessage *message) {
-        GLFWwindow *window = message->getWindow();
-        double x = message->getCoordX();
-        double y = message->getCoordY();
-        double diffx = x - m_window_width / 2; //check the difference between the current x and the last x position
-        double diffy = y - m_window_height / 2; //check the difference between the current y and the last y position
+    /* Casts the ray under the cursor, hit is in terrain units. */
+    bool _pickTerrain(double x, double y, int width, int height, TerrainHit &hit) {
+        if (width <= 0 || height <= 0)
+            return false;
+        glm::mat4 inverse_mvp = glm::inverse(m_projection->perspective() * m_camera->GetMatrix() * m_grid_model_matrix);
+        glm::vec2 ndc = glm::vec2(2.0 * x / width - 1.0, 1.0 - 2.0 * y / height);
+        glm::vec4 near_point = inverse_mvp * glm::vec4(ndc, -1.f, 1.f);
+        glm::vec4 far_point = inverse_mvp * glm::vec4(ndc, 1.f, 1.f);
+        glm::vec3 origin = glm::vec3(near_point) / near_point.w;
+        glm::vec3 target = glm::vec3(far_point) / far_point.w;
+        return m_terrain->Raycast(origin, target - origin, glm::length(target - origin), hit);
+    }
+
+    void mouseCursorCallback(const MouseCursorEvent &event) {
+        double x = event.x;
+        double y = event.y;
+        double diffx = x - m_cursor_x; //check the difference between the current x and the last x position
+        double diffy = y - m_cursor_y; //check the difference between the current y and the last y position
+        m_cursor_x = x;
+        m_cursor_y = y;
+        m_cursor_moved = true;
         float xrot =
                 (float) diffx * 0.1f; //set the xrot to xrot with the addition of the difference in the y position
         float yrot =
                 (float) diffy * 0.1f;// set the xrot to yrot with the addition of the difference in the x position
         glm::vec2 tmp = glm::vec2(xrot * m_fps_sensitivity, yrot * m_fps_sensitivity);
         m_camera->AddRotationFPS(tmp);
-        glfwSetCursorPos(window, m_window_width / 2, m_window_height / 2);
+    }
+
+    /* Called once the events of the frame are handled, so that every cursor event
+     * of a frame is measured from the previous one and not all from the center. */
+    void _recenterCursor() {
+        if (!m_cursor_moved)
+            return;
+        m_cursor_moved = false;
+        m_cursor_x = m_window_width / 2;
+        m_cursor_y = m_window_height / 2;
+        if (m_window)
+            glfwSetCursorPos(m_window, m_cursor_x, m_cursor_y);
     }
 
     // Gets called when the windows/framebuffer is resized.
-    void resize_callback(FrameBufferSizeHandlerMessage *message) {
-        int width = message->getWidth();
-        int height = message->getHeight();
-        m_window_width = width;
-        m_window_height = height;
+    // Only the last size is kept, it is applied at the start of the next frame.
+    void resize_callback(const FrameBufferSizeEvent &event) {
+        m_pending_width = event.width;
+        m_pending_height = event.height;
+        m_resize_pending = true;
+    }
+
+    /* Only the size-dependent targets are reallocated, programs, textures and chunks are kept. */
+    void _applyResize() {
+        /* A minimized window reports a 0x0 framebuffer, keep the previous size until it comes back. */
+        if (!m_resize_pending || m_pending_width <= 0 || m_pending_height <= 0)
+            return;
+        m_resize_pending = false;
+        m_window_width = m_pending_width;
+        m_window_height = m_pending_height;
         m_projection->reGenerateMatrix((GLfloat) m_window_width / m_window_height);
         glViewport(0, 0, m_window_width, m_window_height);
-        framebufferFloor.Cleanup();
-        GLuint fb_tex = (GLuint) framebufferFloor.Init(m_window_width, m_window_height, GL_RGB8);
-        m_terrain->Init(fb_tex);
+        framebufferFloor.Resize(m_window_width, m_window_height);
+        m_cursor_x = m_window_width / 2;
+        m_cursor_y = m_window_height / 2;
     }
 
     void clearCurves() {
@@ -366,21 +606,47 @@ private:
         m_pos_curve.Clear();
     }
 
-    void keyCallback(KeyboardHandlerMessage *message) {
-        GLFWwindow *window = message->getWindow();
-        int key = message->getKey();
-        int mods = message->getMods();
-        int action = message->getAction();
+    void saveCurves() {
+        std::ofstream out(CAMERA_PATH_FILE);
+        if (m_pos_curve.Save(out) && m_look_curve.Save(out))
+            cout << "Camera path saved to " << CAMERA_PATH_FILE << endl;
+        else
+            cerr << "Could not save the camera path to " << CAMERA_PATH_FILE << endl;
+    }
+
+    void loadCurves(const std::string &filename = CAMERA_PATH_FILE) {
+        std::ifstream in(filename.c_str());
+        if (m_camera->getCameraMode() == CAMERA_MODE::Bezier) {
+            m_camera->enableFlyThroughtMode();
+        }
+        /* Both paths are read before either changes, so that they stay in step. */
+        std::vector<glm::vec3> pos_points, look_points;
+        bool pos_loop, look_loop;
+        if (CameraPath::Read(in, pos_points, pos_loop) && CameraPath::Read(in, look_points, look_loop)) {
+            m_pos_curve.setPoints(pos_points, pos_loop);
+            m_look_curve.setPoints(look_points, look_loop);
+            m_loop_curves = m_pos_curve.isLooping();
+            cout << "Camera path loaded from " << filename << endl;
+        }
+        else
+            cerr << "Could not load the camera path from " << filename << endl;
+    }
+
+    void keyCallback(const KeyEvent &event) {
+        GLFWwindow *window = event.window;
+        int key = event.key;
+        int mods = event.mods;
+        int action = event.action;
         if (action == GLFW_PRESS) {
             if (key == GLFW_KEY_W && !m_camera->hasAcceleration(DIRECTION::Forward)) {
                 if (m_camera->getCameraMode() == CAMERA_MODE::Bezier)
-                    m_camera->setBezierStep(m_camera->getBezierStep()*1.1f);
+                    m_camera->setPathSpeed(m_camera->getPathSpeed()*1.1f);
                 else
                     m_camera->setMovement(DIRECTION::Forward);
             }
             if (key == GLFW_KEY_S && !m_camera->hasAcceleration(DIRECTION::Backward)) {
                 if (m_camera->getCameraMode() == CAMERA_MODE::Bezier)
-                    m_camera->setBezierStep(m_camera->getBezierStep()*0.9f);
+                    m_camera->setPathSpeed(m_camera->getPathSpeed()*0.9f);
                 else
                     m_camera->setMovement(DIRECTION::Backward);
             }
@@ -419,6 +685,12 @@ private:
                 else if (m_look_curve.Size() > 1 && m_pos_curve.Size() > 1)
                     m_camera->enableBezierMode(&m_pos_curve, &m_look_curve);
             }
+            if (key == GLFW_KEY_K) {
+                saveCurves();
+            }
+            if (key == GLFW_KEY_O) {
+                loadCurves();
+            }
             if (key == GLFW_KEY_L) {
                 m_loop_curves = !m_loop_curves;
                 m_look_curve.enableLoop(m_loop_curves);
@@ -428,7 +700,6 @@ private:
                 Ball *new_ball = new Ball(-m_camera->getFrontPoint() / TERRAIN_SCALE,
                                           -(m_camera->getFrontPoint() - m_camera->getPosition()), m_terrain);
                 m_balls.push_back(new_ball);
-                new_ball->attach(this);
             }
             if (key == GLFW_KEY_F) {
                 if (m_camera->getCameraMode() == CAMERA_MODE::Fps)
@@ -476,13 +747,23 @@ private:
             }
             switch (key) {
                 case GLFW_KEY_ESCAPE:
-                    glfwSetWindowShouldClose(window, GL_TRUE);
+                    m_quit = true;
+                    if (window)
+                        glfwSetWindowShouldClose(window, GL_TRUE);
                     break;
 
                 case GLFW_KEY_Z:
                     m_amplitude += 0.1f;
                     break;
 
+                case GLFW_KEY_EQUAL:
+                    _setViewDistance(m_terrain->getChunkCount() + 2);
+                    break;
+
+                case GLFW_KEY_MINUS:
+                    _setViewDistance(m_terrain->getChunkCount() - 2);
+                    break;
+
                 case GLFW_KEY_X:
                     m_amplitude -= 0.1f;
                     break;
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <string>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include "../config.h"
+
+/* Command line options of the game. */
+struct GameOptions {
+    /* Input and camera recording written during the session, empty to disable. */
+    std::string record_file;
+    /* Recording played back instead of the live input, empty to disable. */
+    std::string replay_file;
+    /* Frame-time report written at the end of a replay. */
+    std::string report_file = "frame_report.txt";
+    /* CSV file receiving the GPU time of every render pass, empty to disable. */
+    std::string gpu_csv_file;
+    /* Camera path flown from the first frame, empty to disable. */
+    std::string camera_path_file;
+    /* Offscreen rendering without any window, for build servers. */
+    bool headless = false;
+    /* Frames rendered in headless mode when no recording is replayed. */
+    unsigned long headless_frames = 600;
+    /* Directory of the program binary cache, "none" to always compile from source. */
+    std::string shader_cache_dir = SHADER_CACHE_DIR;
+    /* Warn when the tracked GPU allocations exceed this many MB, 0 to never warn. */
+    unsigned long gpu_budget_mb = GPU_MEMORY_BUDGET_MB;
+    /* Size of the terrain in chunks per side, can be changed at runtime. */
+    int view_distance = TERRAIN_CHUNK_SIZE;
+    /* Size of the window, or of the offscreen framebuffer. */
+    int width = 800;
+    int height = 600;
+    /* argv[0], for the usage. */
+    std::string program = "natura";
+
+    bool isRecording() const {
+        return !record_file.empty();
+    }
+
+    bool isReplaying() const {
+        return !replay_file.empty();
+    }
+
+    bool isExportingGpuTimes() const {
+        return !gpu_csv_file.empty();
+    }
+
+    /* Returns false and prints the usage on a malformed command line. */
+    bool Parse(int argc, char *argv[]) {
+        if (argc > 0)
+            program = argv[0];
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) {
+                _usage(argv[0]);
+                return false;
+            }
+            if (arg == "--record")
+                record_file = argv[++i];
+            else if (arg == "--replay")
+                replay_file = argv[++i];
+            else if (arg == "--report")
+                report_file = argv[++i];
+            else if (arg == "--gpu-csv")
+                gpu_csv_file = argv[++i];
+            else if (arg == "--camera-path")
+                camera_path_file = argv[++i];
+            else if (arg == "--headless") {
+                headless = true;
+                char *end;
+                long frames = strtol(argv[++i], &end, 10);
+                if (*end != '\0' || end == argv[i] || frames <= 0) {
+                    _usage(argv[0]);
+                    return false;
+                }
+                headless_frames = (unsigned long) frames;
+            }
+            else if (arg == "--shader-cache")
+                shader_cache_dir = argv[++i];
+            else if (arg == "--gpu-budget") {
+                char *end;
+                long budget = strtol(argv[++i], &end, 10);
+                if (*end != '\0' || end == argv[i] || budget < 0) {
+                    _usage(argv[0]);
+                    return false;
+                }
+                gpu_budget_mb = (unsigned long) budget;
+            }
+            else if (arg == "--view-distance") {
+                char *end;
+                long chunks = strtol(argv[++i], &end, 10);
+                if (*end != '\0' || end == argv[i] || chunks < TERRAIN_CHUNK_SIZE_MIN || chunks > TERRAIN_CHUNK_SIZE_MAX) {
+                    _usage(argv[0]);
+                    return false;
+                }
+                view_distance = (int) chunks;
+            }
+            else if (arg == "--size") {
+                if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                    _usage(argv[0]);
+                    return false;
+                }
+            }
+            else {
+                _usage(argv[0]);
+                return false;
+            }
+        }
+        if (isRecording() && isReplaying()) {
+            std::cerr << "--record and --replay can not be used together" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /* For the errors found after parsing, in the files given on the command line. */
+    void Usage() const {
+        _usage(program.c_str());
+    }
+
+private:
+    void _usage(const char *program) const {
+        std::cerr << "Usage : " << program << " [--record file] [--replay file] [--report file] [--gpu-csv file] [--camera-path file]"
+                  << " [--headless frames] [--size WIDTHxHEIGHT] [--shader-cache directory|none]"
+                  << " [--gpu-budget MB] [--view-distance chunks]" << std::endl;
+    }
+};
@@ -1,6 +1,4 @@
 #version 330
-#define min_fog_distance 30.0f
-#define max_fog_distance 40.0f
 
 in vec2 vTexCoord;
 in float distance_camera;
@@ -8,6 +6,7 @@ in float hOut;
 
 out vec4 color;
 
+uniform vec2 fog_range;  // start and end of the fog
 uniform sampler2D gSampler;
 uniform float amplitude;
 uniform vec4 vColor;
@@ -31,7 +30,7 @@ void main()
 
     vec4 vMixedColor = vTexColor;
 
-     float fog_factor = (max_fog_distance - distance_camera) / (max_fog_distance - min_fog_distance);
+     float fog_factor = (fog_range.y - distance_camera) / (fog_range.y - fog_range.x);
      fog_factor = clamp(fog_factor, 0.0f, 1.0f);
 
     color = vec4(vMixedColor.rgb, min(fNewAlpha, fog_factor));
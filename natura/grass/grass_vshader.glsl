@@ -7,10 +7,16 @@ in vec3 vpoint;
 uniform float amplitude;
 uniform sampler2D perlin_tex;
 
+/* Heightmaps carry a one texel apron around the chunk, see PerlinNoise. */
+vec2 heightmapCoord(vec2 pos){
+    vec2 size = vec2(textureSize(perlin_tex, 0));
+    return (pos * (size - 2.0) + 1.0) / size;
+}
+
 void main()
 {
    vec2 pos_2d = vec2(vpoint.x / noise_size, vpoint.z / noise_size) ;
-   float height = amplitude * (texture(perlin_tex, pos_2d).r - 0.5);
+   float height = amplitude * (texture(perlin_tex, heightmapCoord(pos_2d)).r - 0.5);
    vec3 pos_3d = vec3(vpoint.x, height, vpoint.z);
    gl_Position = vec4(pos_3d, 1.0);
 
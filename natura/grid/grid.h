@@ -7,6 +7,24 @@
 #include "../config.h"
 #include <glm/gtc/type_ptr.hpp>
 #include <cstdint>
+#include "../misc/profiling/cpu_profiler.h"
+#include "../misc/gl_state/gl_state.h"
+#include "../misc/profiling/gpu_memory.h"
+#include "../misc/shaders/shader_variants.h"
+
+/* Features of the grid shaders, see ShaderVariants. */
+enum GridFeature {
+    GRID_SHADOW = 1 << 0,
+    GRID_PCF = 1 << 1
+};
+
+/* Features of the shadow map shaders, set for the chunks on the edges of the terrain. */
+enum GridShadowFeature {
+    GRID_BORDER_X_MIN = 1 << 0,
+    GRID_BORDER_Y_MIN = 1 << 1,
+    GRID_BORDER_X_MAX = 1 << 2,
+    GRID_BORDER_Y_MAX = 1 << 3
+};
 
 class Grid {
 
@@ -14,11 +32,9 @@ private:
     GLuint vertex_array_id_;                // vertex array object
     GLuint vertex_buffer_object_position_;  // memory buffer for positions
     GLuint vertex_buffer_object_index_;     // memory buffer for indices
-    GLuint program_id_;                     // GLSL shader program ID
+    ShaderVariants m_variants;              // GLSL shader programs, one per GridFeature mask
     GLuint texture_perlin_id_;              // texture ID
-    GLuint texture_left_id_;              // texture ID
-    GLuint texture_low_id_;              // texture ID
-    GLuint texture_low_left_id_;
+    GLuint texture_normal_id_;              // baked normals of the chunk
     GLuint texture_grass_id_;               // texture ID
     GLuint texture_rock_id_;                // texture ID
     GLuint texture_snow_id_;                // texture ID
@@ -27,15 +43,28 @@ private:
     GLuint num_indices_;                    // number of vertices to render
     uint32_t mSideNbPoints;                 // grids side X nb of vertices;
     bool mCleanedUp;                        // check if the grid is cleaned before its destruction.
-    GLuint m_shadow_pid;
+    ShaderVariants m_shadow_variants;
     bool m_use_shadows = false;                     // true if we need to generate the Z-buffe
+    bool m_show_shadow = true;
+    bool m_do_pcf = true;
     GLuint m_depth_tex;
+    glm::mat4 m_depth_vp;
+    glm::mat4 m_depth_vp_offset;
+    glm::vec3 m_sun_light_dir;
+    float m_bias = 0.f;
+    int m_terrain_size = TERRAIN_CHUNK_SIZE;
+    glm::vec2 m_fog_range;
 
 public:
 
-    Grid(uint32_t sideSize) {
+    Grid(uint32_t sideSize)
+            : m_variants("grid_vshader.glsl", "grid_fshader.glsl",
+                         {"SHADOW", "PCF"}),
+              m_shadow_variants("shadow_map_vshader.glsl", "shadow_map_fshader.glsl",
+                                {"BORDER_X_MIN", "BORDER_Y_MIN", "BORDER_X_MAX", "BORDER_Y_MAX"}) {
         mSideNbPoints = sideSize;
         mCleanedUp = true;
+        texture_normal_id_ = 0;
     }
 
     ~Grid() {
@@ -43,19 +72,25 @@ public:
             Cleanup();
     }
 
-    void setShadowPID(GLuint pid){
-        m_shadow_pid = pid;
-        glUniform1i(glGetUniformLocation(m_shadow_pid, "perlin_tex"), 0 /*GL_TEXTURE0*/);
-        glUniform1i(glGetUniformLocation(m_shadow_pid, "left_tex"), 6/*GL_TEXTURE0*/);
-        glUniform1i(glGetUniformLocation(m_shadow_pid, "low_tex"), 7 /*GL_TEXTURE0*/);
-        glUniform1i(glGetUniformLocation(m_shadow_pid, "low_left_tex"), 8 /*GL_TEXTURE0*/);
-        glUniform1i(glGetUniformLocation(m_shadow_pid, "shadow_map"), 9 /*GL_TEXTURE0*/);
-    }
-
     void setUseShadowPID(bool enable){
         m_use_shadows = enable;
     }
 
+    /* Selects the shader variants used by the main passes. */
+    void setShadowOptions(bool show_shadow, bool do_pcf){
+        m_show_shadow = show_shadow;
+        m_do_pcf = do_pcf;
+    }
+
+    /* Light transforms of the current frame, uploaded by Draw() to whichever variant is used. */
+    void setShadowMatrices(const glm::mat4 &depth_vp, const glm::mat4 &depth_vp_offset,
+                           glm::vec3 sun_light_dir, float bias){
+        m_depth_vp = depth_vp;
+        m_depth_vp_offset = depth_vp_offset;
+        m_sun_light_dir = sun_light_dir;
+        m_bias = bias;
+    }
+
     void setDepthTex(GLuint tex) {
         m_depth_tex = tex;
     }
@@ -64,45 +99,51 @@ public:
         this->texture_perlin_id_ = id;
     }
 
-    void setTextureLeft(GLuint id){
-        texture_left_id_ = id;
+    void setNormalTextureId(GLuint id){
+        texture_normal_id_ = id;
     }
 
-    void setTextureLow(GLuint id){
-        texture_low_id_ = id;
+    /* Chunks per side of the terrain, the shadow pass pushes down the borders of the last ones. */
+    void setTerrainSize(int size){
+        m_terrain_size = size;
     }
 
-    void setTextureLowLeft(GLuint id){
-        texture_low_left_id_ = id;
+    void setFogRange(glm::vec2 range){
+        m_fog_range = range;
     }
 
     void Cleanup() {
         mCleanedUp = true;
-        glBindVertexArray(0);
-        glUseProgram(0);
+        GL_STATE.BindVertexArray(0);
+        GL_STATE.UseProgram(0);
+        GPU_MEMORY.Free(GPU_OBJECT_BUFFER, vertex_buffer_object_position_);
+        GPU_MEMORY.Free(GPU_OBJECT_BUFFER, vertex_buffer_object_index_);
         glDeleteBuffers(1, &vertex_buffer_object_position_);
         glDeleteBuffers(1, &vertex_buffer_object_index_);
-        glDeleteVertexArrays(1, &vertex_array_id_);
-        glDeleteProgram(program_id_);
-        glDeleteTextures(1, &texture_perlin_id_);
+        GL_STATE.DeleteVertexArrays(1, &vertex_array_id_);
+        m_variants.Cleanup();
+        m_shadow_variants.Cleanup();
+        /* The perlin and normal textures belong to the chunks' heightmaps. */
+        GLuint *materials[] = {&texture_grass_id_, &texture_rock_id_, &texture_snow_id_, &texture_sand_id_,
+                               &texture_deep_water_id_};
+        for (size_t i = 0; i < sizeof(materials) / sizeof(materials[0]); i++) {
+            GPU_MEMORY.Free(GPU_OBJECT_TEXTURE, *materials[i]);
+            GL_STATE.DeleteTextures(1, materials[i]);
+            *materials[i] = 0;
+        }
     }
 
     void Init(GLuint texture_) {
 
         mCleanedUp = false; // Until the next Cleanup() call ...
 
-        // compile the shaders.
-        program_id_ = icg_helper::LoadShaders("grid_vshader.glsl",
-                                              "grid_fshader.glsl");
-        if (!program_id_) {
-            exit(EXIT_FAILURE);
-        }
-
-        glUseProgram(program_id_);
+        m_variants.setSetup([this](GLuint pid) { _setupProgram(pid); });
+        m_shadow_variants.setSetup([this](GLuint pid) { _setupShadowProgram(pid); });
+        m_variants.Request(GRID_SHADOW | GRID_PCF);
 
         // vertex one vertex array
         glGenVertexArrays(1, &vertex_array_id_);
-        glBindVertexArray(vertex_array_id_);
+        GL_STATE.BindVertexArray(vertex_array_id_);
 
         // vertex coordinates and indices
         {
@@ -139,84 +180,47 @@ public:
             glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_position_);
             glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat),
                          &vertices[0], GL_STATIC_DRAW);
+            GPU_MEMORY.Allocate(GPU_OBJECT_BUFFER, vertex_buffer_object_position_, GPU_MEMORY_GEOMETRY,
+                                vertices.size() * sizeof(GLfloat));
 
             // vertex indices
             glGenBuffers(1, &vertex_buffer_object_index_);
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertex_buffer_object_index_);
             glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
                          &indices[0], GL_STATIC_DRAW);
+            GPU_MEMORY.Allocate(GPU_OBJECT_BUFFER, vertex_buffer_object_index_, GPU_MEMORY_GEOMETRY,
+                                indices.size() * sizeof(GLuint));
 
-            // position shader attribute
-            glBindAttribLocation(program_id_, ATTRIB_LOC_position, "position");
-            glLinkProgram(program_id_);
-            //GLuint loc_position = glGetAttribLocation(program_id_, "position");
+            // position shader attribute, its location is set in the shaders
             glEnableVertexAttribArray(ATTRIB_LOC_position);
             glVertexAttribPointer(ATTRIB_LOC_position, 2, GL_FLOAT, DONT_NORMALIZE,
                                   ZERO_STRIDE, ZERO_BUFFER_OFFSET);
         }
 
-        //declaring uniforms
-        {
-            glm::vec3 La = glm::vec3(1.0f, 1.0f, 1.0f);
-            glm::vec3 Ld = glm::vec3(1.0f, 1.0f, 1.0f);
-            glm::vec3 Ls = glm::vec3(1.0f, 1.0f, 1.0f);
-            glm::vec3 light_pos = glm::vec3(0.0f, 100.0f, 0.0f);
-
-            GLuint La_id = glGetUniformLocation(program_id_, "La");
-            GLuint Ld_id = glGetUniformLocation(program_id_, "Ld");
-            GLuint Ls_id = glGetUniformLocation(program_id_, "Ls");
-            GLuint light_pos_id = glGetUniformLocation(program_id_, "light_pos");
-
-            glUniform3fv(La_id, ONE, glm::value_ptr(La));
-            glUniform3fv(Ld_id, ONE, glm::value_ptr(Ld));
-            glUniform3fv(Ls_id, ONE, glm::value_ptr(Ls));
-            glUniform3fv(light_pos_id, ONE, glm::value_ptr(light_pos));
-
-            glm::vec3 ka = glm::vec3(0.18f, 0.1f, 0.1f);
-            glm::vec3 kd = glm::vec3(0.9f, 0.5f, 0.5f);
-            glm::vec3 ks = glm::vec3(0.01f, 0.01f, 0.01f);
-            float alpha = 60.0f;
-
-            GLuint ka_id = glGetUniformLocation(program_id_, "ka");
-            GLuint kd_id = glGetUniformLocation(program_id_, "kd");
-            GLuint ks_id = glGetUniformLocation(program_id_, "ks");
-            GLuint alpha_id = glGetUniformLocation(program_id_, "alpha");
-
-            glUniform3fv(ka_id, ONE, glm::value_ptr(ka));
-            glUniform3fv(kd_id, ONE, glm::value_ptr(kd));
-            glUniform3fv(ks_id, ONE, glm::value_ptr(ks));
-            glUniform1f(alpha_id, alpha);
-        }
+        this->texture_perlin_id_ = texture_;
 
-        //binding perlin texture
-        {
-            //perlin texture
-            this->texture_perlin_id_ = texture_;
-            //glBindTexture(GL_TEXTURE_2D, texture_id_);
-            glUniform1i(glGetUniformLocation(program_id_, "perlin_tex"), 0 /*GL_TEXTURE0*/);
-            glUniform1i(glGetUniformLocation(program_id_, "left_tex"), 6/*GL_TEXTURE0*/);
-            glUniform1i(glGetUniformLocation(program_id_, "low_tex"), 7 /*GL_TEXTURE0*/);
-            glUniform1i(glGetUniformLocation(program_id_, "low_left_tex"), 8 /*GL_TEXTURE0*/);
-            glUniform1i(glGetUniformLocation(program_id_, "shadow_map"), 9 /*GL_TEXTURE0*/);
-        }
+        loadTexture("grass2.tga", &texture_grass_id_);
+        loadTexture("rock.tga", &texture_rock_id_);
+        loadTexture("snow.tga", &texture_snow_id_);
+        loadTexture("sand.tga", &texture_sand_id_);
+        loadTexture("water.tga", &texture_deep_water_id_);
 
-        loadTexture("grass2.tga", &texture_grass_id_, 1, glGetUniformLocation(program_id_, "grass_tex"));
-        loadTexture("rock.tga", &texture_rock_id_, 2, glGetUniformLocation(program_id_, "rock_tex"));
-        loadTexture("snow.tga", &texture_snow_id_, 3, glGetUniformLocation(program_id_, "snow_tex"));
-        loadTexture("sand.tga", &texture_sand_id_, 4, glGetUniformLocation(program_id_, "sand_tex"));
-        loadTexture("water.tga", &texture_deep_water_id_, 5, glGetUniformLocation(program_id_, "water_tex"));
+        // requested above, the other variants are compiled on first use
+        if (!m_variants.Get(GRID_SHADOW | GRID_PCF)) {
+            exit(EXIT_FAILURE);
+        }
 
         // to avoid the current object being polluted
-        glBindVertexArray(0);
-        glUseProgram(0);
+        GL_STATE.BindVertexArray(0);
+        GL_STATE.UseProgram(0);
     }
 
     void Draw(glm::vec2 chunk_pos, glm::vec2 indices, float amplitude, float water_height, float time, const glm::mat4 &model = IDENTITY_MATRIX,
               const glm::mat4 &view = IDENTITY_MATRIX,
               const glm::mat4 &projection = IDENTITY_MATRIX) {
-        GLuint pid = m_use_shadows ? m_shadow_pid : program_id_;
-        glUseProgram(pid);
-        glBindVertexArray(vertex_array_id_);
+        GLuint pid = getDrawPID(chunk_pos);
+        GL_STATE.UseProgram(pid);
+        GL_STATE.BindVertexArray(vertex_array_id_);
         //glUniform1i(glGetUniformLocation(program_id_, "shadow_map"), 1);
         glUniform1f(glGetUniformLocation(pid, "amplitude"), amplitude);
 
@@ -227,58 +231,60 @@ public:
         glUniformMatrix4fv(glGetUniformLocation(pid, "projection"), ONE, DONT_TRANSPOSE, glm::value_ptr(projection));
         glUniform2fv(glGetUniformLocation(pid, "quad_indices"), ONE, glm::value_ptr(indices));
         glUniform2fv(glGetUniformLocation(pid, "chunk_pos"), ONE, glm::value_ptr(chunk_pos));
-        glUniform1i(glGetUniformLocation(pid, "terrain_size"), TERRAIN_CHUNK_SIZE);
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture_perlin_id_);
-
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, texture_grass_id_);
-
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, texture_rock_id_);
+        glUniform2fv(glGetUniformLocation(pid, "fog_range"), ONE, glm::value_ptr(m_fog_range));
+        if (m_use_shadows) {
+            glUniformMatrix4fv(glGetUniformLocation(pid, "depth_vp"), ONE, DONT_TRANSPOSE, glm::value_ptr(m_depth_vp));
+        } else {
+            glUniformMatrix4fv(glGetUniformLocation(pid, "depth_vp_offset"), ONE, DONT_TRANSPOSE,
+                               glm::value_ptr(m_depth_vp_offset));
+            glUniform3fv(glGetUniformLocation(pid, "sun_light_dir"), ONE, glm::value_ptr(m_sun_light_dir));
+            glUniform1f(glGetUniformLocation(pid, "bias"), m_bias);
+            glm::mat3 normal_matrix = glm::inverse(glm::transpose(glm::mat3(view * model)));
+            glUniformMatrix3fv(glGetUniformLocation(pid, "normal_matrix"), ONE, DONT_TRANSPOSE,
+                               glm::value_ptr(normal_matrix));
+        }
 
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, texture_snow_id_);
+        GL_STATE.BindTexture(GL_TEXTURE0, GL_TEXTURE_2D, texture_perlin_id_);
 
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, texture_sand_id_);
+        GL_STATE.BindTexture(GL_TEXTURE1, GL_TEXTURE_2D, texture_grass_id_);
 
-        glActiveTexture(GL_TEXTURE5);
-        glBindTexture(GL_TEXTURE_2D, texture_deep_water_id_);
+        GL_STATE.BindTexture(GL_TEXTURE2, GL_TEXTURE_2D, texture_rock_id_);
 
-        glActiveTexture(GL_TEXTURE6);
-        glBindTexture(GL_TEXTURE_2D, texture_left_id_);
+        GL_STATE.BindTexture(GL_TEXTURE3, GL_TEXTURE_2D, texture_snow_id_);
 
-        glUniform1i(glGetUniformLocation(pid, "left_present"), texture_left_id_ != 0);
+        GL_STATE.BindTexture(GL_TEXTURE4, GL_TEXTURE_2D, texture_sand_id_);
 
-        glActiveTexture(GL_TEXTURE7);
-        glBindTexture(GL_TEXTURE_2D, texture_low_id_);
-        glUniform1i(glGetUniformLocation(pid, "low_present"), texture_low_id_ != 0);
+        GL_STATE.BindTexture(GL_TEXTURE5, GL_TEXTURE_2D, texture_deep_water_id_);
 
-        glActiveTexture(GL_TEXTURE8);
-        glBindTexture(GL_TEXTURE_2D, texture_low_left_id_);
-        glUniform1i(glGetUniformLocation(pid, "low_left_present"), texture_low_left_id_ != 0);
+        GL_STATE.BindTexture(GL_TEXTURE6, GL_TEXTURE_2D, m_depth_tex);
 
-        glActiveTexture(GL_TEXTURE9);
-        glBindTexture(GL_TEXTURE_2D, m_depth_tex);
+        GL_STATE.BindTexture(GL_TEXTURE7, GL_TEXTURE_2D, texture_normal_id_);
 
         // draw
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        GL_STATE.Enable(GL_BLEND);
+        GL_STATE.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
         glDrawElements(GL_TRIANGLE_STRIP, num_indices_, GL_UNSIGNED_INT, 0);
-        glDisable(GL_BLEND);
-
-        glBindVertexArray(0);
-        glUseProgram(0);
     }
 
-    GLuint getPID(){
-        return program_id_;
+    /* Program used by Draw() for a tile of the chunk at chunk_pos. */
+    GLuint getDrawPID(glm::vec2 chunk_pos){
+        if (m_use_shadows) {
+            uint32_t mask = 0;
+            mask |= chunk_pos.x == 0 ? GRID_BORDER_X_MIN : 0;
+            mask |= chunk_pos.y == 0 ? GRID_BORDER_Y_MIN : 0;
+            mask |= chunk_pos.x == m_terrain_size - 1 ? GRID_BORDER_X_MAX : 0;
+            mask |= chunk_pos.y == m_terrain_size - 1 ? GRID_BORDER_Y_MAX : 0;
+            return m_shadow_variants.Get(mask);
+        }
+        uint32_t mask = 0;
+        mask |= m_show_shadow ? GRID_SHADOW : 0;
+        mask |= m_show_shadow && m_do_pcf ? GRID_PCF : 0;
+        return m_variants.Get(mask);
     }
 
-    void loadTexture(string filename, GLuint *texture_id, int tex_index, GLint tex_id_uniform) {
+    void loadTexture(string filename, GLuint *texture_id) {
+        PROFILE_SCOPE("Grid::loadTexture");
         // load grass texture
         int width;
         int height;
@@ -293,7 +299,7 @@ public:
         }
 
         glGenTextures(1, texture_id);
-        glBindTexture(GL_TEXTURE_2D, *texture_id);
+        GL_STATE.BindTexture(GL_TEXTURE_2D, *texture_id);
 
         if (nb_component == 3) {
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0,
@@ -306,14 +312,50 @@ public:
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glGenerateMipmap(GL_TEXTURE_2D);
-
-        glUniform1i(tex_id_uniform, tex_index /*GL_TEXTURE*/);
+        GPU_MEMORY.Allocate(GPU_OBJECT_TEXTURE, *texture_id, GPU_MEMORY_MATERIALS,
+                            GpuMemoryTracker::TextureBytes(GL_RGBA, width, height, true));
 
         // cleanup
         stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        GL_STATE.BindTexture(GL_TEXTURE_2D, 0);
     }
 
+private:
+    void _setupProgram(GLuint pid) {
+
+        glm::vec3 La = glm::vec3(1.0f, 1.0f, 1.0f);
+        glm::vec3 Ld = glm::vec3(1.0f, 1.0f, 1.0f);
+        glm::vec3 Ls = glm::vec3(1.0f, 1.0f, 1.0f);
+        glm::vec3 light_pos = glm::vec3(0.0f, 100.0f, 0.0f);
+
+        glUniform3fv(glGetUniformLocation(pid, "La"), ONE, glm::value_ptr(La));
+        glUniform3fv(glGetUniformLocation(pid, "Ld"), ONE, glm::value_ptr(Ld));
+        glUniform3fv(glGetUniformLocation(pid, "Ls"), ONE, glm::value_ptr(Ls));
+        glUniform3fv(glGetUniformLocation(pid, "light_pos"), ONE, glm::value_ptr(light_pos));
+
+        glm::vec3 ka = glm::vec3(0.18f, 0.1f, 0.1f);
+        glm::vec3 kd = glm::vec3(0.9f, 0.5f, 0.5f);
+        glm::vec3 ks = glm::vec3(0.01f, 0.01f, 0.01f);
+        float alpha = 60.0f;
+
+        glUniform3fv(glGetUniformLocation(pid, "ka"), ONE, glm::value_ptr(ka));
+        glUniform3fv(glGetUniformLocation(pid, "kd"), ONE, glm::value_ptr(kd));
+        glUniform3fv(glGetUniformLocation(pid, "ks"), ONE, glm::value_ptr(ks));
+        glUniform1f(glGetUniformLocation(pid, "alpha"), alpha);
+
+        glUniform1i(glGetUniformLocation(pid, "perlin_tex"), 0 /*GL_TEXTURE0*/);
+        glUniform1i(glGetUniformLocation(pid, "grass_tex"), 1 /*GL_TEXTURE1*/);
+        glUniform1i(glGetUniformLocation(pid, "rock_tex"), 2 /*GL_TEXTURE2*/);
+        glUniform1i(glGetUniformLocation(pid, "snow_tex"), 3 /*GL_TEXTURE3*/);
+        glUniform1i(glGetUniformLocation(pid, "sand_tex"), 4 /*GL_TEXTURE4*/);
+        glUniform1i(glGetUniformLocation(pid, "water_tex"), 5 /*GL_TEXTURE5*/);
+        glUniform1i(glGetUniformLocation(pid, "shadow_map"), 6 /*GL_TEXTURE6*/);
+        glUniform1i(glGetUniformLocation(pid, "normal_tex"), 7 /*GL_TEXTURE7*/);
+    }
+
+    void _setupShadowProgram(GLuint pid) {
+        glUniform1i(glGetUniformLocation(pid, "perlin_tex"), 0 /*GL_TEXTURE0*/);
+    }
 };
 
 Grid *BASE_TILE;
\ No newline at end of file
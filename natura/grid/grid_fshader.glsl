@@ -1,15 +1,14 @@
 #version 330
 #define noise_size 4.0f
-#define min_fog_distance 30.0f
-#define max_fog_distance 40.0f
 
 in vec2 uv;
 in vec3 light_dir;
-in mat4 MV;
 in float distance_camera;
 in vec4 shadow_coord;
 
 out vec4 out_color;
+/* Where the fog starts and where it hides everything, set from the view distance. */
+uniform vec2 fog_range;
 uniform vec2 quad_indices;
 uniform sampler2D perlin_tex;
 uniform sampler2D grass_tex;
@@ -17,22 +16,17 @@ uniform sampler2D rock_tex;
 uniform sampler2D snow_tex;
 uniform sampler2D sand_tex;
 uniform sampler2D water_tex;
-
-uniform sampler2D left_tex;
-uniform bool left_present;
-uniform sampler2D low_tex;
-uniform bool low_present;
-uniform sampler2D low_left_tex;
-uniform bool low_left_present;
+/* Baked by the noise pass, packed in [0, 1]. */
+uniform sampler2D normal_tex;
 
 uniform mat4 model;
+/* inverse(transpose(mat3(view * model))) */
+uniform mat3 normal_matrix;
 
 
 /* Shadows */
 uniform float bias;
 uniform sampler2D shadow_map;
-uniform bool show_shadow;
-uniform bool do_pcf;
 uniform vec3 sun_light_dir;
 uniform bool use_color;  // Use predefined color or texture?
 
@@ -61,19 +55,10 @@ vec2 poisson_disk[16] = vec2[](
    vec2(0.14383161, -0.14100790)
 );
 
-float getTextureVal(vec2 pos){
-    if (pos.x >= 1.0f && pos.y >= 1.0 && low_left_present){
-        return texture(low_left_tex, vec2(pos.x - 1.0f, pos.y - 1.0f)).r;
-    }
-    else if(pos.x >= 1.0f && low_present){
-        return texture(low_tex, vec2(pos.x - 1.0f, pos.y)).r;
-    }
-    else if (pos.y >= 1.0f && left_present){
-        return texture(left_tex, vec2(pos.x, pos.y - 1.0f)).r;
-    }
-    else{
-        return texture(perlin_tex, pos).r;
-    }
+/* Heightmaps carry a one texel apron around the chunk, see PerlinNoise. */
+vec2 heightmapCoord(vec2 pos){
+    vec2 size = vec2(textureSize(perlin_tex, 0));
+    return (pos * (size - 2.0) + 1.0) / size;
 }
 
 float getPercentage( float value,  float min,  float max ){
@@ -86,7 +71,7 @@ void main() {
     vec2 pos_2d = uv;
     vec3 color;
 
-    float height = ((texture(perlin_tex, pos_2d).r) + 1.0f) / 2.0f;
+    float height = ((texture(perlin_tex, heightmapCoord(pos_2d)).r) + 1.0f) / 2.0f;
     vec3 grassColor = texture(grass_tex, pos_2d* 10.f).rgb;
     vec3 rockColor = texture(rock_tex, pos_2d* 2.0f).rgb;
     vec3 snowColor = texture(snow_tex, pos_2d* 5).rgb;
@@ -112,15 +97,9 @@ void main() {
         color = waterColor;
     }
 
-    float epsilon = 0.005f;
-    float zDiffXaxis = getTextureVal(vec2(pos_2d.x + epsilon, pos_2d.y)) -
-                        getTextureVal(vec2(pos_2d.x - epsilon, pos_2d.y));
-    float zDiffYaxis = getTextureVal(vec2(pos_2d.x, pos_2d.y + epsilon))-
-                        getTextureVal(vec2(pos_2d.x, pos_2d.y - epsilon));
-
-    vec3 normal = normalize(cross(vec3(2 *epsilon, zDiffXaxis, 0.0f), vec3(0.0, zDiffYaxis, 2* epsilon)));
-    vec3 n = mat3(model) * -normal; // Normal in worlds coordinates.
-    normal = (inverse(transpose(MV)) * vec4(-normal, 1.0f)).xyz;
+    vec3 normal = normalize(texture(normal_tex, heightmapCoord(pos_2d)).xyz * 2.0f - 1.0f);
+    vec3 n = mat3(model) * normal; // Normal in worlds coordinates.
+    normal = normal_matrix * normal;
 
     vec3 ambient = color * 0.6 * La;
 
@@ -134,7 +113,7 @@ void main() {
 
     vec3 specular = ks * pow(dotRv, alpha) * Ls;
 
-    float fog_factor = (max_fog_distance - distance_camera) / (max_fog_distance - min_fog_distance);
+    float fog_factor = (fog_range.y - distance_camera) / (fog_range.y - fog_range.x);
     fog_factor = clamp(fog_factor, 0.0f, 1.0f);
 
     //color = mix(fog_colour, ambient + diffuse +specular, fog_factor);
@@ -146,25 +125,25 @@ void main() {
 
         // shading factor from the shadow (1.0 = no shadow, 0.0 = all dark)
         float shadow = 1.0;
-        if (show_shadow) {
-            // perspective division
-            vec3 shadow_coord_norm = shadow_coord.xyz / shadow_coord.w;
-            if (!do_pcf) {
-                // Read only 1 shadow sample.
-                if (texture(shadow_map, shadow_coord_norm.xy).r <
-                    (shadow_coord_norm.z - bias)) {
-                    shadow = 0.2;
-                }
-            } else {
-                // Do percentage closer filtering with 16 samples
-                for (int i = 0; i < 16; i++) {
-                  if (texture(shadow_map, shadow_coord_norm.xy + poisson_disk[i]
-                              / 200.0).r < (shadow_coord_norm.z - bias)) {
-                    shadow -= 0.04;
-                  }
-                }
-            }
+#ifdef SHADOW
+        // perspective division
+        vec3 shadow_coord_norm = shadow_coord.xyz / shadow_coord.w;
+#ifndef PCF
+        // Read only 1 shadow sample.
+        if (texture(shadow_map, shadow_coord_norm.xy).r <
+            (shadow_coord_norm.z - bias)) {
+            shadow = 0.2;
+        }
+#else
+        // Do percentage closer filtering with 16 samples
+        for (int i = 0; i < 16; i++) {
+          if (texture(shadow_map, shadow_coord_norm.xy + poisson_disk[i]
+                      / 200.0).r < (shadow_coord_norm.z - bias)) {
+            shadow -= 0.04;
+          }
         }
+#endif
+#endif
 
             color = shadow * shade * color.rgb;
 
@@ -19,6 +19,7 @@
 #include "physics/material_point.h"
 #include "physics/ball.h"
 #include "camera/camera.h"
+#include "misc/headless/headless_context.h"
 
 using namespace glm;
 
@@ -29,9 +30,50 @@ void ErrorCallback(int error, const char *description) {
     fputs(description, stderr);
 }
 
+// Renders without any window into an offscreen framebuffer (build servers, CI).
+int RunHeadless(const GameOptions &options) {
+#ifdef NATURA_HEADLESS
+    HeadlessContext context;
+    if (!context.Init(options.width, options.height)) {
+        context.Cleanup();
+        return EXIT_FAILURE;
+    }
+
+    // GLEW 1.x also initializes GLX, which fails without an X display even though
+    // the GL entry points are loaded fine, so only check those.
+    glewExperimental = GL_TRUE;
+    glewInit();
+    glGetError();
+    if (!glGenFramebuffers || !context.InitFramebuffer()) {
+        fprintf(stderr, "Failed to initialize GLEW\n");
+        context.Cleanup();
+        return EXIT_FAILURE;
+    }
+
+    cout << "OpenGL" << glGetString(GL_VERSION) << " (headless, " << glGetString(GL_RENDERER) << ")" << endl;
+    {
+        Game game(NULL, options);
+        game.run();
+    }
+    context.Cleanup();
+    return EXIT_SUCCESS;
+#else
+    (void) options;
+    fprintf(stderr, "Headless mode needs EGL, rebuild with libEGL installed\n");
+    return EXIT_FAILURE;
+#endif
+}
+
 int main(int argc, char *argv[]) {
-    int window_width = 800;
-    int window_height = 600;
+    GameOptions options;
+    if (!options.Parse(argc, argv)) {
+        return EXIT_FAILURE;
+    }
+    if (options.headless) {
+        return RunHeadless(options);
+    }
+    int window_width = options.width;
+    int window_height = options.height;
     // GLFW Initialization
     if (!glfwInit()) {
         fprintf(stderr, "Failed to initialize GLFW\n");
@@ -70,8 +112,10 @@ int main(int argc, char *argv[]) {
     }
 
     cout << "OpenGL" << glGetString(GL_VERSION) << endl;
-    Game game(window);
-    game.run();
+    {
+        Game game(window, options);
+        game.run();
+    }
     // close OpenGL window and terminate GLFW
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <iostream>
+
+/* Value-typed, allocation-free event bus.
+ * Every event type gets its own preallocated ring buffer. Publish() copies the
+ * event into the ring, Dispatch() drains all the rings and hands the events to
+ * the typed handlers. Dispatch() is called once per frame from Game::run, so
+ * handlers always run at the same point of the frame. */
+
+#define EVENT_QUEUE_CAPACITY 256
+
+class EventQueueBase {
+public:
+    virtual ~EventQueueBase() { }
+
+    virtual void Drain() = 0;
+
+    virtual void Unsubscribe(uint32_t id) = 0;
+};
+
+/* RAII handle on a subscription : the handler is detached when the handle dies.
+ * Handles are move-only, an empty handle (default constructed, moved from or
+ * reset) does nothing. */
+class Subscription {
+public:
+    Subscription() {
+        m_queue = NULL;
+        m_id = 0;
+    }
+
+    Subscription(EventQueueBase *queue, uint32_t id) {
+        m_queue = queue;
+        m_id = id;
+    }
+
+    Subscription(Subscription &&other) {
+        m_queue = other.m_queue;
+        m_id = other.m_id;
+        other.m_queue = NULL;
+    }
+
+    Subscription &operator=(Subscription &&other) {
+        if (this != &other) {
+            Reset();
+            m_queue = other.m_queue;
+            m_id = other.m_id;
+            other.m_queue = NULL;
+        }
+        return *this;
+    }
+
+    Subscription(const Subscription &) = delete;
+
+    Subscription &operator=(const Subscription &) = delete;
+
+    ~Subscription() {
+        Reset();
+    }
+
+    void Reset() {
+        if (m_queue) {
+            m_queue->Unsubscribe(m_id);
+            m_queue = NULL;
+        }
+    }
+
+    bool isActive() {
+        return m_queue != NULL;
+    }
+
+private:
+    EventQueueBase *m_queue;
+    uint32_t m_id;
+};
+
+template<typename E>
+class EventQueue : public EventQueueBase {
+public:
+    typedef std::function<void(const E &)> Handler;
+
+    EventQueue(size_t capacity) : m_ring(capacity) {
+        m_head = 0;
+        m_count = 0;
+        m_dropped = 0;
+        m_next_id = 0;
+        m_draining = false;
+    }
+
+    void Push(const E &event) {
+        if (m_count == m_ring.size()) {
+            /* Full : the oldest event is dropped. */
+            m_head = (m_head + 1) % m_ring.size();
+            m_count--;
+            if (m_dropped++ == 0) {
+                std::cerr << "Warning : event queue overflow, dropping events." << std::endl;
+            }
+        }
+        m_ring[(m_head + m_count) % m_ring.size()] = event;
+        m_count++;
+    }
+
+    /* Returns 0 if owner is already subscribed to this queue. */
+    uint32_t Subscribe(const void *owner, Handler handler) {
+        if (owner != NULL && (_findOwner(m_handlers, owner) || _findOwner(m_added, owner)))
+            return 0;
+        Entry entry;
+        entry.id = ++m_next_id;
+        entry.owner = owner;
+        entry.handler = handler;
+        entry.active = true;
+        /* A push_back during a drain could move the handler that is running. */
+        if (m_draining)
+            m_added.push_back(entry);
+        else
+            m_handlers.push_back(entry);
+        return entry.id;
+    }
+
+    virtual void Unsubscribe(uint32_t id) {
+        for (size_t i = 0; i < m_added.size(); i++) {
+            if (m_added[i].id == id) {
+                m_added.erase(m_added.begin() + i);
+                return;
+            }
+        }
+        for (size_t i = 0; i < m_handlers.size(); i++) {
+            if (m_handlers[i].id == id) {
+                if (m_draining) {
+                    /* Removed once the drain is over, the loop is iterating on m_handlers. */
+                    m_handlers[i].active = false;
+                }
+                else {
+                    m_handlers.erase(m_handlers.begin() + i);
+                }
+                return;
+            }
+        }
+    }
+
+    size_t SubscriberCount() {
+        return m_handlers.size() + m_added.size();
+    }
+
+    virtual void Drain() {
+        m_draining = true;
+        /* Events published by the handlers themselves wait for the next Dispatch(). */
+        size_t pending = m_count;
+        while (pending-- > 0) {
+            E event = m_ring[m_head];
+            m_head = (m_head + 1) % m_ring.size();
+            m_count--;
+            for (size_t i = 0; i < m_handlers.size(); i++) {
+                if (m_handlers[i].active)
+                    m_handlers[i].handler(event);
+            }
+        }
+        m_draining = false;
+        for (size_t i = m_handlers.size(); i-- > 0;) {
+            if (!m_handlers[i].active)
+                m_handlers.erase(m_handlers.begin() + i);
+        }
+        /* Subscribed during the drain, they receive the events from the next Dispatch() on. */
+        m_handlers.insert(m_handlers.end(), m_added.begin(), m_added.end());
+        m_added.clear();
+    }
+
+private:
+    std::vector<E> m_ring;
+    size_t m_head;
+    size_t m_count;
+    size_t m_dropped;
+
+    struct Entry {
+        uint32_t id;
+        const void *owner;
+        Handler handler;
+        bool active;
+    };
+    std::vector<Entry> m_handlers;
+    /* Subscriptions made while draining, appended to m_handlers afterwards. */
+    std::vector<Entry> m_added;
+    uint32_t m_next_id;
+    bool m_draining;
+
+    static bool _findOwner(const std::vector<Entry> &entries, const void *owner) {
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (entries[i].active && entries[i].owner == owner)
+                return true;
+        }
+        return false;
+    }
+};
+
+class EventBus {
+public:
+    template<typename E>
+    void Publish(const E &event) {
+        _queue<E>().Push(event);
+    }
+
+    /* The handler stays attached as long as the returned handle lives. When an
+     * owner is given and it is already subscribed to E, nothing is attached twice
+     * and the returned handle is empty. */
+    template<typename E>
+    Subscription Subscribe(typename EventQueue<E>::Handler handler, const void *owner = NULL) {
+        EventQueue<E> &queue = _queue<E>();
+        uint32_t id = queue.Subscribe(owner, handler);
+        if (id == 0)
+            return Subscription();
+        return Subscription(&queue, id);
+    }
+
+    template<typename E>
+    size_t SubscriberCount() {
+        return _queue<E>().SubscriberCount();
+    }
+
+    void Dispatch() {
+        for (size_t i = 0; i < m_queues.size(); i++) {
+            if (m_queues[i])
+                m_queues[i]->Drain();
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<EventQueueBase> > m_queues;
+
+    static size_t _nextTypeId() {
+        static size_t next = 0;
+        return next++;
+    }
+
+    /* One id per event type, shared by all the buses. */
+    template<typename E>
+    static size_t _typeId() {
+        static const size_t id = _nextTypeId();
+        return id;
+    }
+
+    template<typename E>
+    EventQueue<E> &_queue() {
+        size_t id = _typeId<E>();
+        if (id >= m_queues.size())
+            m_queues.resize(id + 1);
+        if (!m_queues[id])
+            m_queues[id].reset(new EventQueue<E>(EVENT_QUEUE_CAPACITY));
+        return *static_cast<EventQueue<E> *>(m_queues[id].get());
+    }
+};
+
+EventBus EVENT_BUS;
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <GLFW/glfw3.h>
+
+/* All the events going through the EVENT_BUS. They are plain values, copied into the queues. */
+
+class Ball;
+
+struct KeyEvent {
+    GLFWwindow *window;
+    int key;
+    int scancode;
+    int action;
+    int mods;
+};
+
+struct MouseButtonEvent {
+    GLFWwindow *window;
+    int button;
+    int action;
+    int mods;
+};
+
+struct MouseCursorEvent {
+    GLFWwindow *window;
+    double x;
+    double y;
+};
+
+struct FrameBufferSizeEvent {
+    GLFWwindow *window;
+    int width;
+    int height;
+};
+
+struct BallOutOfBoundsEvent {
+    Ball *ball;
+};
+
+struct PerlinNoisePropChangedEvent {
+};
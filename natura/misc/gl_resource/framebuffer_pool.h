@@ -0,0 +1,125 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <iostream>
+#include "../../framebuffer.h"
+
+/* Recycles render targets: a released framebuffer keeps its storage and is
+ * handed out again by the next Acquire() with the same size and format, so
+ * targets that come and go every few frames (the chunk heightmaps) stop
+ * allocating once the pool is warm. The pool owns every target it created. */
+class FrameBufferPool {
+public:
+    FrameBufferPool() {
+        m_created = 0;
+        m_reused = 0;
+    }
+
+    FrameBuffer *Acquire(int width, int height, GLint internal_format, bool use_interpolation = true,
+                         GpuMemoryCategory category = GPU_MEMORY_OTHER, GLint secondary_format = 0) {
+        std::vector<FrameBuffer *> &free = m_free[Key(width, height, internal_format, secondary_format,
+                                                      use_interpolation, category)];
+        if (!free.empty()) {
+            FrameBuffer *frame_buffer = free.back();
+            free.pop_back();
+            m_reused++;
+            return frame_buffer;
+        }
+        FrameBuffer *frame_buffer = new FrameBuffer();
+        frame_buffer->Init(width, height, internal_format, use_interpolation, category, secondary_format);
+        m_targets.push_back(frame_buffer);
+        m_created++;
+        return frame_buffer;
+    }
+
+    /* The target may have been resized since it was acquired, it goes back under its current size. */
+    void Release(FrameBuffer *frame_buffer) {
+        if (!frame_buffer)
+            return;
+        glm::vec2 size = frame_buffer->getSize();
+        m_free[Key((int) size.x, (int) size.y, frame_buffer->getInternalFormat(), frame_buffer->getSecondaryFormat(),
+                   frame_buffer->usesInterpolation(), frame_buffer->getMemoryCategory())].push_back(frame_buffer);
+    }
+
+    /* Deletes the free targets, the acquired ones stay valid. */
+    void Trim() {
+        for (std::map<Key, std::vector<FrameBuffer *> >::iterator it = m_free.begin(); it != m_free.end(); ++it) {
+            for (size_t i = 0; i < it->second.size(); i++) {
+                _destroy(it->second[i]);
+            }
+        }
+        m_free.clear();
+    }
+
+    size_t getLiveCount() {
+        return m_targets.size();
+    }
+
+    void Report(std::ostream &out) {
+        out << "Framebuffer pool : " << m_targets.size() << " targets, " << m_created << " created, "
+            << m_reused << " reused" << std::endl;
+    }
+
+    /* Deletes every target, acquired or not. */
+    void Cleanup() {
+        for (size_t i = 0; i < m_targets.size(); i++) {
+            m_targets[i]->Cleanup();
+            delete m_targets[i];
+        }
+        m_targets.clear();
+        m_free.clear();
+    }
+
+private:
+    struct Key {
+        int width;
+        int height;
+        GLint internal_format;
+        GLint secondary_format;
+        bool use_interpolation;
+        GpuMemoryCategory category;
+
+        Key(int w, int h, GLint format, GLint secondary, bool interpolation, GpuMemoryCategory c) {
+            width = w;
+            height = h;
+            internal_format = format;
+            secondary_format = secondary;
+            use_interpolation = interpolation;
+            category = c;
+        }
+
+        bool operator<(const Key &other) const {
+            if (width != other.width)
+                return width < other.width;
+            if (height != other.height)
+                return height < other.height;
+            if (internal_format != other.internal_format)
+                return internal_format < other.internal_format;
+            if (secondary_format != other.secondary_format)
+                return secondary_format < other.secondary_format;
+            if (use_interpolation != other.use_interpolation)
+                return use_interpolation < other.use_interpolation;
+            return category < other.category;
+        }
+    };
+
+    std::map<Key, std::vector<FrameBuffer *> > m_free;
+    std::vector<FrameBuffer *> m_targets;
+    unsigned long m_created;
+    unsigned long m_reused;
+
+    void _destroy(FrameBuffer *frame_buffer) {
+        for (size_t i = 0; i < m_targets.size(); i++) {
+            if (m_targets[i] == frame_buffer) {
+                m_targets[i] = m_targets.back();
+                m_targets.pop_back();
+                break;
+            }
+        }
+        frame_buffer->Cleanup();
+        delete frame_buffer;
+    }
+};
+
+FrameBufferPool FRAMEBUFFER_POOL;
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <GL/glew.h>
+#include "../gl_state/gl_state.h"
+#include "../profiling/gpu_memory.h"
+
+/* Owns one GL object name and deletes it when destroyed or reset. Handles can
+ * be moved but not copied, so each object has exactly one owner. The
+ * destructors may run after the context is gone, which is why the classes
+ * holding handles still reset them in their Cleanup(). */
+template<typename Traits>
+class GLHandle {
+public:
+    GLHandle() {
+        m_id = 0;
+    }
+
+    explicit GLHandle(GLuint id) {
+        m_id = id;
+    }
+
+    GLHandle(GLHandle &&other) {
+        m_id = other.m_id;
+        other.m_id = 0;
+    }
+
+    GLHandle &operator=(GLHandle &&other) {
+        if (this != &other) {
+            Reset(other.m_id);
+            other.m_id = 0;
+        }
+        return *this;
+    }
+
+    GLHandle(const GLHandle &) = delete;
+
+    GLHandle &operator=(const GLHandle &) = delete;
+
+    ~GLHandle() {
+        Reset();
+    }
+
+    /* Deletes the current object, if any, and creates a new one. */
+    GLuint Create() {
+        Reset(Traits::Create());
+        return m_id;
+    }
+
+    /* Deletes the current object, if any, and takes ownership of id. */
+    void Reset(GLuint id = 0) {
+        if (m_id && m_id != id)
+            Traits::Delete(m_id);
+        m_id = id;
+    }
+
+    /* Gives up ownership without deleting. */
+    GLuint Release() {
+        GLuint id = m_id;
+        m_id = 0;
+        return id;
+    }
+
+    GLuint getId() const {
+        return m_id;
+    }
+
+    bool isValid() const {
+        return m_id != 0;
+    }
+
+private:
+    GLuint m_id;
+};
+
+struct GLTextureTraits {
+    static GLuint Create() {
+        GLuint id;
+        glGenTextures(1, &id);
+        return id;
+    }
+
+    static void Delete(GLuint id) {
+        GPU_MEMORY.Free(GPU_OBJECT_TEXTURE, id);
+        GL_STATE.DeleteTextures(1, &id);
+    }
+};
+
+struct GLBufferTraits {
+    static GLuint Create() {
+        GLuint id;
+        glGenBuffers(1, &id);
+        return id;
+    }
+
+    static void Delete(GLuint id) {
+        GPU_MEMORY.Free(GPU_OBJECT_BUFFER, id);
+        glDeleteBuffers(1, &id);
+    }
+};
+
+struct GLFramebufferTraits {
+    static GLuint Create() {
+        GLuint id;
+        glGenFramebuffers(1, &id);
+        return id;
+    }
+
+    static void Delete(GLuint id) {
+        glDeleteFramebuffers(1, &id);
+    }
+};
+
+struct GLRenderbufferTraits {
+    static GLuint Create() {
+        GLuint id;
+        glGenRenderbuffers(1, &id);
+        return id;
+    }
+
+    static void Delete(GLuint id) {
+        GPU_MEMORY.Free(GPU_OBJECT_RENDERBUFFER, id);
+        glDeleteRenderbuffers(1, &id);
+    }
+};
+
+struct GLVertexArrayTraits {
+    static GLuint Create() {
+        GLuint id;
+        glGenVertexArrays(1, &id);
+        return id;
+    }
+
+    static void Delete(GLuint id) {
+        GL_STATE.DeleteVertexArrays(1, &id);
+    }
+};
+
+struct GLProgramTraits {
+    static GLuint Create() {
+        return glCreateProgram();
+    }
+
+    static void Delete(GLuint id) {
+        GL_STATE.DeleteProgram(id);
+    }
+};
+
+typedef GLHandle<GLTextureTraits> TextureHandle;
+typedef GLHandle<GLBufferTraits> BufferHandle;
+typedef GLHandle<GLFramebufferTraits> FramebufferHandle;
+typedef GLHandle<GLRenderbufferTraits> RenderbufferHandle;
+typedef GLHandle<GLVertexArrayTraits> VertexArrayHandle;
+typedef GLHandle<GLProgramTraits> ProgramHandle;
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <map>
+#include <iostream>
+
+/* Texture units tracked by the cache, units above are passed through. */
+#define GL_STATE_TEXTURE_UNITS 16
+
+/* Shadows the GL state the renderer changes the most (program, VAO, texture
+ * bindings, capabilities and blend function) and drops the calls that would
+ * not change it. All such calls must go through GL_STATE, code that bypasses
+ * it has to call Invalidate() afterwards. */
+class GLStateCache {
+public:
+    GLStateCache() {
+        m_issued = 0;
+        m_skipped = 0;
+        m_frames = 0;
+        Invalidate();
+    }
+
+    /* Forgets everything, the next call of each kind reaches the driver. */
+    void Invalidate() {
+        m_program = UNKNOWN;
+        m_vertex_array = UNKNOWN;
+        m_active_unit = UNKNOWN;
+        for (int i = 0; i < GL_STATE_TEXTURE_UNITS; i++) {
+            for (int t = 0; t < TARGET_COUNT; t++) {
+                m_textures[i][t] = UNKNOWN;
+            }
+        }
+        m_capabilities.clear();
+        m_blend_src = UNKNOWN;
+        m_blend_dst = UNKNOWN;
+    }
+
+    void UseProgram(GLuint program) {
+        if (_skip(m_program == program))
+            return;
+        m_program = program;
+        glUseProgram(program);
+    }
+
+    void BindVertexArray(GLuint vertex_array) {
+        if (_skip(m_vertex_array == vertex_array))
+            return;
+        m_vertex_array = vertex_array;
+        glBindVertexArray(vertex_array);
+    }
+
+    /* Same as glActiveTexture, to be followed by calls acting on the active unit. */
+    void ActiveTexture(GLenum unit) {
+        if (_skip(m_active_unit == unit))
+            return;
+        m_active_unit = unit;
+        glActiveTexture(unit);
+    }
+
+    /* Same as glBindTexture, on the active unit. */
+    void BindTexture(GLenum target, GLuint texture) {
+        int unit = (int) m_active_unit - GL_TEXTURE0;
+        int t = _target(target);
+        if (m_active_unit == UNKNOWN || unit >= GL_STATE_TEXTURE_UNITS || t < 0) {
+            m_issued++;
+            glBindTexture(target, texture);
+            return;
+        }
+        if (_skip(m_textures[unit][t] == texture))
+            return;
+        m_textures[unit][t] = texture;
+        glBindTexture(target, texture);
+    }
+
+    /* Binds texture to the given unit, the active unit only changes when a bind is needed. */
+    void BindTexture(GLenum unit, GLenum target, GLuint texture) {
+        int index = (int) unit - GL_TEXTURE0;
+        int t = _target(target);
+        if (index < GL_STATE_TEXTURE_UNITS && t >= 0 && m_textures[index][t] == texture) {
+            m_skipped += 2;
+            return;
+        }
+        ActiveTexture(unit);
+        BindTexture(target, texture);
+    }
+
+    void Enable(GLenum capability) {
+        _set(capability, true);
+    }
+
+    void Disable(GLenum capability) {
+        _set(capability, false);
+    }
+
+    void BlendFunc(GLenum src, GLenum dst) {
+        if (_skip(m_blend_src == src && m_blend_dst == dst))
+            return;
+        m_blend_src = src;
+        m_blend_dst = dst;
+        glBlendFunc(src, dst);
+    }
+
+    /* Deleting a bound object resets its binding to 0, and a new object may get the same name. */
+    void DeleteProgram(GLuint program) {
+        if (m_program == program)
+            m_program = 0;
+        glDeleteProgram(program);
+    }
+
+    void DeleteVertexArrays(GLsizei n, const GLuint *vertex_arrays) {
+        for (GLsizei i = 0; i < n; i++) {
+            if (m_vertex_array == vertex_arrays[i])
+                m_vertex_array = 0;
+        }
+        glDeleteVertexArrays(n, vertex_arrays);
+    }
+
+    void DeleteTextures(GLsizei n, const GLuint *textures) {
+        for (GLsizei i = 0; i < n; i++) {
+            for (int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++) {
+                for (int t = 0; t < TARGET_COUNT; t++) {
+                    if (m_textures[unit][t] == textures[i])
+                        m_textures[unit][t] = 0;
+                }
+            }
+        }
+        glDeleteTextures(n, textures);
+    }
+
+    void EndFrame() {
+        m_frames++;
+    }
+
+    unsigned long getIssuedCount() {
+        return m_issued;
+    }
+
+    /* Number of redundant calls that never reached the driver. */
+    unsigned long getSkippedCount() {
+        return m_skipped;
+    }
+
+    void Report(std::ostream &out) {
+        unsigned long frames = m_frames > 0 ? m_frames : 1;
+        out << "GL state : " << m_issued / frames << " calls issued and " << m_skipped / frames
+        << " redundant calls removed per frame" << std::endl;
+    }
+
+private:
+    static const GLuint UNKNOWN = 0xFFFFFFFF;
+    enum { TARGET_2D = 0, TARGET_CUBE_MAP = 1, TARGET_1D = 2, TARGET_COUNT = 3 };
+
+    GLuint m_program;
+    GLuint m_vertex_array;
+    GLenum m_active_unit;
+    GLuint m_textures[GL_STATE_TEXTURE_UNITS][TARGET_COUNT];
+    std::map<GLenum, bool> m_capabilities;
+    GLenum m_blend_src;
+    GLenum m_blend_dst;
+
+    unsigned long m_issued;
+    unsigned long m_skipped;
+    unsigned long m_frames;
+
+    bool _skip(bool redundant) {
+        if (redundant)
+            m_skipped++;
+        else
+            m_issued++;
+        return redundant;
+    }
+
+    static int _target(GLenum target) {
+        switch (target) {
+            case GL_TEXTURE_2D:
+                return TARGET_2D;
+            case GL_TEXTURE_CUBE_MAP:
+                return TARGET_CUBE_MAP;
+            case GL_TEXTURE_1D:
+                return TARGET_1D;
+            default:
+                return -1;
+        }
+    }
+
+    void _set(GLenum capability, bool enabled) {
+        std::map<GLenum, bool>::iterator it = m_capabilities.find(capability);
+        if (_skip(it != m_capabilities.end() && it->second == enabled))
+            return;
+        m_capabilities[capability] = enabled;
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+};
+
+GLStateCache GL_STATE;
@@ -0,0 +1,164 @@
+#pragma once
+
+/* Offscreen OpenGL context for machines without a display, built only when
+ * CMake finds libEGL (NATURA_HEADLESS). With Mesa this runs on llvmpipe. */
+
+#ifdef NATURA_HEADLESS
+
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <iostream>
+#include <cstring>
+#include "../../config.h"
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+/* EGL context made current without any surface (or a pbuffer when surfaceless
+ * contexts are not supported) and an FBO standing in for the window. */
+class HeadlessContext {
+public:
+    HeadlessContext() {
+        m_display = EGL_NO_DISPLAY;
+        m_context = EGL_NO_CONTEXT;
+        m_surface = EGL_NO_SURFACE;
+        m_framebuffer = 0;
+        m_color_buffer = 0;
+        m_depth_buffer = 0;
+    }
+
+    /* Creates and makes current a 3.2 core context. */
+    bool Init(int width, int height) {
+        m_width = width;
+        m_height = height;
+
+        m_display = _surfacelessDisplay();
+        if (m_display == EGL_NO_DISPLAY)
+            m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        EGLint major, minor;
+        if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor)) {
+            std::cerr << "Failed to initialize EGL" << std::endl;
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            std::cerr << "EGL does not support desktop OpenGL" << std::endl;
+            return false;
+        }
+
+        const EGLint config_attribs[] = {
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+                EGL_DEPTH_SIZE, 24,
+                EGL_NONE
+        };
+        EGLConfig config;
+        EGLint config_count = 0;
+        if (!eglChooseConfig(m_display, config_attribs, &config, 1, &config_count) || config_count == 0) {
+            std::cerr << "No suitable EGL config" << std::endl;
+            return false;
+        }
+
+        const EGLint context_attribs[] = {
+                EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+                EGL_CONTEXT_MINOR_VERSION_KHR, 2,
+                EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+                EGL_NONE
+        };
+        m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, context_attribs);
+        if (m_context == EGL_NO_CONTEXT) {
+            std::cerr << "Failed to create the EGL context" << std::endl;
+            return false;
+        }
+
+        if (!_hasExtension(eglQueryString(m_display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+            const EGLint pbuffer_attribs[] = {EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+            m_surface = eglCreatePbufferSurface(m_display, config, pbuffer_attribs);
+        }
+        if (!eglMakeCurrent(m_display, m_surface, m_surface, m_context)) {
+            std::cerr << "Failed to make the EGL context current" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /* Needs the GL functions to be loaded (glewInit). */
+    bool InitFramebuffer() {
+        glGenRenderbuffers(1, &m_color_buffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_color_buffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_width, m_height);
+        glGenRenderbuffers(1, &m_depth_buffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_depth_buffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_width, m_height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &m_framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color_buffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth_buffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "!!!ERROR: Headless framebuffer not OK :(" << std::endl;
+            return false;
+        }
+        /* Every pass going back to "the screen" now renders here. */
+        DEFAULT_FRAMEBUFFER = m_framebuffer;
+        return true;
+    }
+
+    void Cleanup() {
+        if (m_framebuffer) {
+            DEFAULT_FRAMEBUFFER = 0;
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glDeleteFramebuffers(1, &m_framebuffer);
+            glDeleteRenderbuffers(1, &m_color_buffer);
+            glDeleteRenderbuffers(1, &m_depth_buffer);
+            m_framebuffer = 0;
+        }
+        if (m_display != EGL_NO_DISPLAY) {
+            eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (m_surface != EGL_NO_SURFACE)
+                eglDestroySurface(m_display, m_surface);
+            if (m_context != EGL_NO_CONTEXT)
+                eglDestroyContext(m_display, m_context);
+            eglTerminate(m_display);
+            m_display = EGL_NO_DISPLAY;
+        }
+    }
+
+private:
+    EGLDisplay m_display;
+    EGLContext m_context;
+    EGLSurface m_surface;
+    GLuint m_framebuffer;
+    GLuint m_color_buffer;
+    GLuint m_depth_buffer;
+    int m_width;
+    int m_height;
+
+    static bool _hasExtension(const char *extensions, const char *name) {
+        if (!extensions)
+            return false;
+        size_t length = strlen(name);
+        for (const char *p = strstr(extensions, name); p; p = strstr(p + length, name)) {
+            if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+                return true;
+        }
+        return false;
+    }
+
+    /* Mesa's surfaceless platform does not need any display server. */
+    EGLDisplay _surfacelessDisplay() {
+        const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (!_hasExtension(client_extensions, "EGL_MESA_platform_surfaceless"))
+            return EGL_NO_DISPLAY;
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (!get_platform_display)
+            return EGL_NO_DISPLAY;
+        return get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+};
+
+#endif
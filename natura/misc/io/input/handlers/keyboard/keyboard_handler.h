@@ -2,31 +2,19 @@
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
-#include "../../../../observer_subject/subject.h"
-#include "../../../../observer_subject/messages/keyboard_handler_message.h"
+#include "../../../../event_bus/event_bus.h"
+#include "../../../../event_bus/events.h"
 
-class KeyboardHandler : public Subject{
+class KeyboardHandler {
 public:
     KeyboardHandler(GLFWwindow *window){
-        glfwSetKeyCallback(window, keyCallback);
-    }
-
-    virtual void attach(Observer *obs){
-        m_inner_subject.attach(obs);
-    }
-
-    virtual void notify(Message *msg){
-        m_inner_subject.notify(msg);
+        if (window)
+            glfwSetKeyCallback(window, keyCallback);
     }
 
 private:
     static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods){
-        Message *m = new KeyboardHandlerMessage(window, key, scancode, action, mods);
-        m_inner_subject.notify(m);
-        delete m;
+        KeyEvent e = {window, key, scancode, action, mods};
+        EVENT_BUS.Publish(e);
     }
-
-    static Subject m_inner_subject;
 };
-
-Subject KeyboardHandler::m_inner_subject;
\ No newline at end of file
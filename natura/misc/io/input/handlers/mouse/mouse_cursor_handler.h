@@ -2,32 +2,20 @@
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
-#include "../../../../observer_subject/subject.h"
-#include "../../../../observer_subject/messages/mouse_cursor_handler_message.h"
+#include "../../../../event_bus/event_bus.h"
+#include "../../../../event_bus/events.h"
 
 
-class MouseCursorHandler : public Subject{
+class MouseCursorHandler {
 public:
     MouseCursorHandler(GLFWwindow *window){
-        glfwSetCursorPosCallback(window, mouseCursor);
-    }
-
-    virtual void attach(Observer *obs){
-        m_inner_subject.attach(obs);
-    }
-
-    virtual void notify(Message *msg){
-        m_inner_subject.notify(msg);
+        if (window)
+            glfwSetCursorPosCallback(window, mouseCursor);
     }
 
 private:
     static void mouseCursor(GLFWwindow *window, double x, double y){
-        Message *m = new MouseCursorHandlerMessage(window, x, y);
-        m_inner_subject.notify(m);
-        delete m;
+        MouseCursorEvent e = {window, x, y};
+        EVENT_BUS.Publish(e);
     }
-
-    static Subject m_inner_subject;
 };
-
-Subject MouseCursorHandler::m_inner_subject;
\ No newline at end of file
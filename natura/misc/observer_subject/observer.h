@@ -1,8 +0,0 @@
-#pragma once
-
-#include "messages/message.h"
-
-class Observer {
-public:
-    virtual void update(Message *msg) = 0;
-};
\ No newline at end of file
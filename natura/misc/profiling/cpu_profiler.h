@@ -0,0 +1,147 @@
+#pragma once
+
+/* Scoped CPU profiler exporting Chrome trace events (chrome://tracing, Perfetto).
+ * Everything compiles to nothing unless NATURA_PROFILE is defined, see the
+ * NATURA_PROFILE option of the CMake project.
+ *
+ *   PROFILE_SCOPE("Terrain::Draw");       times the enclosing scope
+ *   PROFILE_FLUSH("profile_trace.json");  writes every buffered event */
+
+#ifdef NATURA_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Events kept per thread, the oldest ones are overwritten first. */
+#define CPU_PROFILER_EVENTS_PER_THREAD (1 << 16)
+
+class CpuProfiler {
+public:
+    struct Event {
+        const char *name;
+        int64_t start_us;
+        int64_t duration_us;
+    };
+
+    /* Written by its thread only, read by the flushing thread. */
+    struct ThreadBuffer {
+        int tid;
+        std::vector<Event> events;
+        std::atomic<uint64_t> count;
+
+        ThreadBuffer(int id) : tid(id), events(CPU_PROFILER_EVENTS_PER_THREAD), count(0) { }
+    };
+
+    CpuProfiler() {
+        m_origin = std::chrono::steady_clock::now();
+    }
+
+    ~CpuProfiler() {
+        for (size_t i = 0; i < m_buffers.size(); i++)
+            delete m_buffers[i];
+    }
+
+    int64_t Now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - m_origin).count();
+    }
+
+    /* Lock free, the only lock is taken once per thread to register its buffer. */
+    void Record(const char *name, int64_t start_us, int64_t end_us) {
+        ThreadBuffer *buffer = _threadBuffer();
+        uint64_t index = buffer->count.load(std::memory_order_relaxed);
+        Event &e = buffer->events[index % CPU_PROFILER_EVENTS_PER_THREAD];
+        e.name = name;
+        e.start_us = start_us;
+        e.duration_us = end_us - start_us;
+        buffer->count.store(index + 1, std::memory_order_release);
+    }
+
+    /* Events recorded concurrently by other threads while flushing may be torn or missing. */
+    bool WriteChromeTrace(const std::string &filename) {
+        std::ofstream out(filename.c_str());
+        if (!out) {
+            std::cerr << "Could not write the profile to " << filename << std::endl;
+            return false;
+        }
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < m_buffers.size(); i++) {
+            ThreadBuffer *buffer = m_buffers[i];
+            uint64_t count = buffer->count.load(std::memory_order_acquire);
+            uint64_t begin = count > CPU_PROFILER_EVENTS_PER_THREAD ? count - CPU_PROFILER_EVENTS_PER_THREAD : 0;
+            for (uint64_t j = begin; j < count; j++) {
+                const Event &e = buffer->events[j % CPU_PROFILER_EVENTS_PER_THREAD];
+                out << (first ? "\n" : ",\n");
+                out << "{\"name\":\"" << _escape(e.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"ts\":" << e.start_us << ",\"dur\":" << e.duration_us << "}";
+                first = false;
+            }
+        }
+        out << "\n]}\n";
+        std::cout << "CPU profile written to " << filename << std::endl;
+        return (bool) out;
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_origin;
+    std::mutex m_mutex;
+    std::vector<ThreadBuffer *> m_buffers;
+
+    ThreadBuffer *_threadBuffer() {
+        static thread_local ThreadBuffer *buffer = NULL;
+        if (!buffer) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            buffer = new ThreadBuffer((int) m_buffers.size());
+            m_buffers.push_back(buffer);
+        }
+        return buffer;
+    }
+
+    static std::string _escape(const char *name) {
+        std::string escaped;
+        for (const char *c = name; *c; c++) {
+            if (*c == '"' || *c == '\\')
+                escaped += '\\';
+            escaped += *c;
+        }
+        return escaped;
+    }
+};
+
+CpuProfiler CPU_PROFILER;
+
+class CpuProfileScope {
+public:
+    CpuProfileScope(const char *name) {
+        m_name = name;
+        m_start = CPU_PROFILER.Now();
+    }
+
+    ~CpuProfileScope() {
+        CPU_PROFILER.Record(m_name, m_start, CPU_PROFILER.Now());
+    }
+
+private:
+    const char *m_name;
+    int64_t m_start;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_SCOPE(name) CpuProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_FLUSH(filename) CPU_PROFILER.WriteChromeTrace(filename)
+
+#else
+
+#define PROFILE_SCOPE(name) do { } while (0)
+#define PROFILE_FLUSH(filename) do { } while (0)
+
+#endif
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstdio>
+#include <map>
+#include <utility>
+#include <iostream>
+#include <iomanip>
+
+/* Subsystem an allocation is charged to. */
+enum GpuMemoryCategory {
+    GPU_MEMORY_HEIGHTMAPS,
+    GPU_MEMORY_REFLECTION,
+    GPU_MEMORY_SHADOW_MAP,
+    GPU_MEMORY_MATERIALS,
+    GPU_MEMORY_GRASS,
+    GPU_MEMORY_GEOMETRY,
+    GPU_MEMORY_OTHER,
+    GPU_MEMORY_CATEGORY_COUNT
+};
+
+enum GpuObjectKind {
+    GPU_OBJECT_TEXTURE,
+    GPU_OBJECT_RENDERBUFFER,
+    GPU_OBJECT_BUFFER
+};
+
+/* Bytes of video memory held by each subsystem, with their high-water marks.
+ * Every texture, renderbuffer and buffer storage is declared with Allocate()
+ * right after the GL call that specifies it, and forgotten with Free() when
+ * the object is deleted (the GLHandle deleters do it). Sizes are estimates
+ * from the formats, drivers add their own padding and metadata.
+ * When a budget is set, crossing it prints a warning once until the total
+ * goes back under it. */
+class GpuMemoryTracker {
+public:
+    GpuMemoryTracker() {
+        for (int i = 0; i < GPU_MEMORY_CATEGORY_COUNT; i++) {
+            m_bytes[i] = 0;
+            m_peak[i] = 0;
+        }
+        m_total = 0;
+        m_total_peak = 0;
+        m_budget = 0;
+        m_over_budget = false;
+    }
+
+    /* 0 disables the warnings. */
+    void setBudget(size_t bytes) {
+        m_budget = bytes;
+        m_over_budget = false;
+        _checkBudget();
+    }
+
+    size_t getBudget() {
+        return m_budget;
+    }
+
+    /* Declares the storage of an object, replacing what it held before (a re-specified texture). */
+    void Allocate(GpuObjectKind kind, GLuint name, GpuMemoryCategory category, size_t bytes) {
+        if (!name)
+            return;
+        Free(kind, name);
+        Allocation &allocation = m_allocations[std::make_pair((int) kind, name)];
+        allocation.category = category;
+        allocation.bytes = bytes;
+        m_bytes[category] += bytes;
+        m_total += bytes;
+        if (m_bytes[category] > m_peak[category])
+            m_peak[category] = m_bytes[category];
+        if (m_total > m_total_peak)
+            m_total_peak = m_total;
+        _checkBudget();
+    }
+
+    void Free(GpuObjectKind kind, GLuint name) {
+        std::map<std::pair<int, GLuint>, Allocation>::iterator it = m_allocations.find(std::make_pair((int) kind, name));
+        if (it == m_allocations.end())
+            return;
+        m_bytes[it->second.category] -= it->second.bytes;
+        m_total -= it->second.bytes;
+        m_allocations.erase(it);
+        if (m_over_budget && m_total <= m_budget)
+            m_over_budget = false;
+    }
+
+    size_t getBytes(GpuMemoryCategory category) {
+        return m_bytes[category];
+    }
+
+    size_t getPeakBytes(GpuMemoryCategory category) {
+        return m_peak[category];
+    }
+
+    size_t getTotalBytes() {
+        return m_total;
+    }
+
+    size_t getTotalPeakBytes() {
+        return m_total_peak;
+    }
+
+    void Report(std::ostream &out) {
+        std::ios::fmtflags flags = out.flags();
+        std::streamsize precision = out.precision();
+        out << std::fixed << std::setprecision(1);
+        out << "GPU memory : " << _mb(m_total) << " MB allocated, peak " << _mb(m_total_peak) << " MB";
+        if (m_budget)
+            out << ", budget " << _mb(m_budget) << " MB";
+        out << std::endl;
+        for (int i = 0; i < GPU_MEMORY_CATEGORY_COUNT; i++) {
+            if (!m_peak[i])
+                continue;
+            out << "    " << CategoryName((GpuMemoryCategory) i) << " : " << _mb(m_bytes[i]) << " MB, peak "
+                << _mb(m_peak[i]) << " MB" << std::endl;
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+    static const char *CategoryName(GpuMemoryCategory category) {
+        switch (category) {
+            case GPU_MEMORY_HEIGHTMAPS:
+                return "heightmaps";
+            case GPU_MEMORY_REFLECTION:
+                return "reflection";
+            case GPU_MEMORY_SHADOW_MAP:
+                return "shadow map";
+            case GPU_MEMORY_MATERIALS:
+                return "materials";
+            case GPU_MEMORY_GRASS:
+                return "grass";
+            case GPU_MEMORY_GEOMETRY:
+                return "geometry";
+            default:
+                return "other";
+        }
+    }
+
+    /* Estimated size of one pixel. RGB formats are padded to 4 bytes by most drivers. */
+    static size_t BytesPerPixel(GLint internal_format) {
+        switch (internal_format) {
+            case GL_R8:
+                return 1;
+            case GL_R16F:
+                return 2;
+            case GL_RGB32F:
+                return 12;
+            case GL_RGBA32F:
+                return 16;
+            case GL_RGB16F:
+            case GL_RGBA16F:
+                return 8;
+            default:
+                /* GL_R32F, GL_RGB(8), GL_RGBA(8), GL_DEPTH_COMPONENT24/32 */
+                return 4;
+        }
+    }
+
+    /* A full mipmap chain adds a third to the base level. */
+    static size_t TextureBytes(GLint internal_format, int width, int height, bool mipmaps = false) {
+        size_t bytes = (size_t) width * height * BytesPerPixel(internal_format);
+        return mipmaps ? bytes + bytes / 3 : bytes;
+    }
+
+private:
+    struct Allocation {
+        GpuMemoryCategory category;
+        size_t bytes;
+    };
+
+    std::map<std::pair<int, GLuint>, Allocation> m_allocations;
+    size_t m_bytes[GPU_MEMORY_CATEGORY_COUNT];
+    size_t m_peak[GPU_MEMORY_CATEGORY_COUNT];
+    size_t m_total;
+    size_t m_total_peak;
+    size_t m_budget;
+    bool m_over_budget;
+
+    static double _mb(size_t bytes) {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+    void _checkBudget() {
+        if (!m_budget || m_over_budget || m_total <= m_budget)
+            return;
+        m_over_budget = true;
+        int largest = 0;
+        for (int i = 1; i < GPU_MEMORY_CATEGORY_COUNT; i++) {
+            if (m_bytes[i] > m_bytes[largest])
+                largest = i;
+        }
+        fprintf(stderr, "GPU memory over budget : %.1f MB allocated for %.1f MB, %s use %.1f MB\n",
+                _mb(m_total), _mb(m_budget), CategoryName((GpuMemoryCategory) largest), _mb(m_bytes[largest]));
+    }
+};
+
+GpuMemoryTracker GPU_MEMORY;
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+/* Number of frames whose queries can be in flight before their slot is reused. */
+#define GPU_TIMER_FRAMES_IN_FLIGHT 3
+/* Number of frames kept in the in-memory history of each pass. */
+#define GPU_TIMER_HISTORY 240
+
+/* GPU time per render pass, measured with GL_TIMESTAMP queries so that passes
+ * can be nested (a pass inside Terrain::Draw inside the shadow pass, ...).
+ * A pass can be entered several times per frame, its intervals are summed.
+ * Results are read GPU_TIMER_FRAMES_IN_FLIGHT frames later so that reading
+ * them never waits on the GPU. */
+class GpuTimer {
+public:
+    GpuTimer() {
+        m_enabled = false;
+        m_in_frame = false;
+        m_frame = 0;
+        m_slot = 0;
+        m_dropped_frames = 0;
+    }
+
+    /* Needs a context, the timer stays disabled if timer queries are missing. */
+    void Init() {
+        m_enabled = GLEW_ARB_timer_query || GLEW_VERSION_3_3;
+        if (!m_enabled)
+            std::cerr << "Timer queries are not supported, GPU timings are disabled" << std::endl;
+        for (int i = 0; i < GPU_TIMER_FRAMES_IN_FLIGHT; i++) {
+            m_slots[i].frame = 0;
+            m_slots[i].used = 0;
+            m_slots[i].last_query = 0;
+            m_slots[i].pending = false;
+        }
+    }
+
+    void setCsvFile(const std::string &filename) {
+        m_csv.open(filename.c_str());
+        if (!m_csv) {
+            std::cerr << "Could not open " << filename << " for the GPU timings" << std::endl;
+            return;
+        }
+        m_csv << "frame,pass,ms\n";
+    }
+
+    void BeginFrame() {
+        if (!m_enabled)
+            return;
+        Slot &slot = m_slots[m_slot];
+        if (slot.pending && !_collect(slot))
+            m_dropped_frames++;
+        slot.frame = m_frame;
+        slot.used = 0;
+        slot.last_query = 0;
+        slot.pending = false;
+        m_in_frame = true;
+    }
+
+    void EndFrame() {
+        if (!m_enabled)
+            return;
+        m_slots[m_slot].pending = true;
+        m_slot = (m_slot + 1) % GPU_TIMER_FRAMES_IN_FLIGHT;
+        m_frame++;
+        m_in_frame = false;
+        /* Collect whatever is already available, the slot will not wait for it later. */
+        for (int i = 0; i < GPU_TIMER_FRAMES_IN_FLIGHT; i++) {
+            if (m_slots[i].pending && _available(m_slots[i]))
+                _collect(m_slots[i]);
+        }
+    }
+
+    /* Returns a handle to give to End(), -1 when nothing is measured. */
+    int Begin(const char *pass) {
+        if (!m_enabled || !m_in_frame)
+            return -1;
+        Slot &slot = m_slots[m_slot];
+        if (slot.used == slot.intervals.size()) {
+            Interval interval;
+            glGenQueries(2, interval.queries);
+            slot.intervals.push_back(interval);
+        }
+        int handle = (int) slot.used++;
+        Interval &interval = slot.intervals[handle];
+        interval.pass = _passIndex(pass);
+        glQueryCounter(interval.queries[0], GL_TIMESTAMP);
+        slot.last_query = interval.queries[0];
+        return handle;
+    }
+
+    void End(int handle) {
+        if (handle < 0 || !m_in_frame)
+            return;
+        Slot &slot = m_slots[m_slot];
+        glQueryCounter(slot.intervals[handle].queries[1], GL_TIMESTAMP);
+        slot.last_query = slot.intervals[handle].queries[1];
+    }
+
+    /* Milliseconds of the pass for the last GPU_TIMER_HISTORY collected frames, oldest first. */
+    const std::deque<double> &getHistory(const std::string &pass) {
+        return m_history[_passIndex(pass.c_str())];
+    }
+
+    double getAverage(const std::string &pass) {
+        const std::deque<double> &history = getHistory(pass);
+        double sum = 0.0;
+        for (size_t i = 0; i < history.size(); i++)
+            sum += history[i];
+        return history.empty() ? 0.0 : sum / history.size();
+    }
+
+    void Report(std::ostream &out) {
+        if (!m_enabled)
+            return;
+        out << "GPU time per pass (average over the last " << GPU_TIMER_HISTORY << " frames) :" << std::endl;
+        for (size_t i = 0; i < m_pass_names.size(); i++) {
+            out << "  " << m_pass_names[i] << " " << getAverage(m_pass_names[i]) << " ms" << std::endl;
+        }
+        if (m_dropped_frames > 0)
+            out << "  " << m_dropped_frames << " frames dropped (results not ready in time)" << std::endl;
+    }
+
+    void Cleanup() {
+        for (int i = 0; i < GPU_TIMER_FRAMES_IN_FLIGHT; i++) {
+            for (size_t j = 0; j < m_slots[i].intervals.size(); j++) {
+                glDeleteQueries(2, m_slots[i].intervals[j].queries);
+            }
+            m_slots[i].intervals.clear();
+            m_slots[i].used = 0;
+            m_slots[i].last_query = 0;
+            m_slots[i].pending = false;
+        }
+        m_csv.close();
+    }
+
+private:
+    struct Interval {
+        GLuint queries[2];
+        int pass;
+    };
+
+    struct Slot {
+        unsigned long frame;
+        std::vector<Interval> intervals;
+        size_t used;
+        /* Issued last, the intervals nest so it is usually the end of the first one. */
+        GLuint last_query;
+        bool pending;
+    };
+
+    bool m_enabled;
+    bool m_in_frame;
+    unsigned long m_frame;
+    int m_slot;
+    unsigned long m_dropped_frames;
+    Slot m_slots[GPU_TIMER_FRAMES_IN_FLIGHT];
+    std::map<std::string, int> m_pass_ids;
+    std::vector<std::string> m_pass_names;
+    std::vector<std::deque<double> > m_history;
+    std::vector<double> m_frame_sums;
+    std::ofstream m_csv;
+
+    int _passIndex(const char *pass) {
+        std::map<std::string, int>::iterator it = m_pass_ids.find(pass);
+        if (it != m_pass_ids.end())
+            return it->second;
+        int index = (int) m_pass_names.size();
+        m_pass_ids[pass] = index;
+        m_pass_names.push_back(pass);
+        m_history.push_back(std::deque<double>());
+        return index;
+    }
+
+    /* The queries of a frame complete in order, checking the last issued one is enough. */
+    bool _available(const Slot &slot) {
+        if (slot.last_query == 0)
+            return true;
+        GLint available = 0;
+        glGetQueryObjectiv(slot.last_query, GL_QUERY_RESULT_AVAILABLE, &available);
+        return available != 0;
+    }
+
+    /* Returns false, without reading anything, if the results are not ready yet. */
+    bool _collect(Slot &slot) {
+        if (!_available(slot))
+            return false;
+        slot.pending = false;
+        m_frame_sums.assign(m_pass_names.size(), -1.0);
+        for (size_t i = 0; i < slot.used; i++) {
+            GLuint64 begin, end;
+            glGetQueryObjectui64v(slot.intervals[i].queries[0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(slot.intervals[i].queries[1], GL_QUERY_RESULT, &end);
+            double &sum = m_frame_sums[slot.intervals[i].pass];
+            sum = std::max(sum, 0.0) + (end - begin) / 1e6;
+        }
+        for (size_t pass = 0; pass < m_frame_sums.size(); pass++) {
+            if (m_frame_sums[pass] < 0.0)
+                continue;
+            m_history[pass].push_back(m_frame_sums[pass]);
+            if (m_history[pass].size() > GPU_TIMER_HISTORY)
+                m_history[pass].pop_front();
+            if (m_csv.is_open())
+                m_csv << slot.frame << "," << m_pass_names[pass] << "," << m_frame_sums[pass] << "\n";
+        }
+        return true;
+    }
+};
+
+GpuTimer GPU_TIMER;
+
+/* Measures the GPU time of the enclosing scope under the given pass name. */
+class GpuTimerScope {
+public:
+    GpuTimerScope(const char *pass) {
+        m_handle = GPU_TIMER.Begin(pass);
+    }
+
+    ~GpuTimerScope() {
+        GPU_TIMER.End(m_handle);
+    }
+
+private:
+    int m_handle;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cmath>
+
+/* Collects frame times and writes min / mean / percentiles / max. */
+class FrameTimeReport {
+public:
+    void AddFrame(double seconds) {
+        m_frame_times.push_back(seconds);
+    }
+
+    size_t FrameCount() {
+        return m_frame_times.size();
+    }
+
+    /* p in [0, 1], nearest rank. */
+    double Percentile(double p) {
+        if (m_frame_times.empty())
+            return 0.0;
+        std::vector<double> sorted = m_frame_times;
+        std::sort(sorted.begin(), sorted.end());
+        size_t rank = (size_t) std::ceil(p * sorted.size());
+        rank = std::min(std::max(rank, (size_t) 1), sorted.size());
+        return sorted[rank - 1];
+    }
+
+    double Mean() {
+        if (m_frame_times.empty())
+            return 0.0;
+        double sum = 0.0;
+        for (size_t i = 0; i < m_frame_times.size(); i++) {
+            sum += m_frame_times[i];
+        }
+        return sum / m_frame_times.size();
+    }
+
+    void Write(std::ostream &out) {
+        out << "frames " << FrameCount() << "\n";
+        out << "min_ms " << 1000.0 * Percentile(0.0) << "\n";
+        out << "mean_ms " << 1000.0 * Mean() << "\n";
+        out << "p50_ms " << 1000.0 * Percentile(0.50) << "\n";
+        out << "p95_ms " << 1000.0 * Percentile(0.95) << "\n";
+        out << "p99_ms " << 1000.0 * Percentile(0.99) << "\n";
+        out << "max_ms " << 1000.0 * Percentile(1.0) << "\n";
+    }
+
+    bool Write(const std::string &filename) {
+        std::ofstream out(filename.c_str());
+        if (!out)
+            return false;
+        Write(out);
+        return (bool) out;
+    }
+
+private:
+    std::vector<double> m_frame_times;
+};
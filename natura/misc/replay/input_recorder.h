@@ -0,0 +1,55 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "replay_format.h"
+#include "../event_bus/event_bus.h"
+#include "../event_bus/events.h"
+
+/* Writes every input event going through the EVENT_BUS, tagged with the frame
+ * that handles it, together with the clock and the camera state of each frame. */
+class InputRecorder {
+public:
+    InputRecorder(const std::string &filename, double start_time) : m_out(filename.c_str()) {
+        if (!m_out) {
+            throw std::runtime_error("Could not open " + filename + " for recording");
+        }
+        m_out.precision(17);
+        m_frame = 0;
+        m_out << "R " << start_time << "\n";
+
+        m_subscriptions.push_back(EVENT_BUS.Subscribe<KeyEvent>([this](const KeyEvent &e) {
+            m_out << "K " << m_frame << " " << e.key << " " << e.scancode << " " << e.action << " " << e.mods << "\n";
+        }));
+        m_subscriptions.push_back(EVENT_BUS.Subscribe<MouseButtonEvent>([this](const MouseButtonEvent &e) {
+            m_out << "B " << m_frame << " " << e.button << " " << e.action << " " << e.mods << "\n";
+        }));
+        m_subscriptions.push_back(EVENT_BUS.Subscribe<MouseCursorEvent>([this](const MouseCursorEvent &e) {
+            m_out << "M " << m_frame << " " << e.x << " " << e.y << "\n";
+        }));
+        m_subscriptions.push_back(EVENT_BUS.Subscribe<FrameBufferSizeEvent>([this](const FrameBufferSizeEvent &e) {
+            m_out << "S " << m_frame << " " << e.width << " " << e.height << "\n";
+        }));
+    }
+
+    void BeginFrame(unsigned long frame, double time) {
+        m_frame = frame;
+        m_out << "F " << m_frame << " " << time << "\n";
+    }
+
+    /* Sizes set outside of the bus (initial window size) must be recorded explicitly. */
+    void RecordFrameBufferSize(int width, int height) {
+        m_out << "S " << m_frame << " " << width << " " << height << "\n";
+    }
+
+    void RecordCamera(const CameraState &state) {
+        m_out << "C " << m_frame << " " << state.position.x << " " << state.position.y << " " << state.position.z
+        << " " << state.rotation.x << " " << state.rotation.y << "\n";
+    }
+
+private:
+    std::ofstream m_out;
+    unsigned long m_frame;
+    std::vector<Subscription> m_subscriptions;
+};
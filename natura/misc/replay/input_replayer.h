@@ -0,0 +1,166 @@
+#pragma once
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <GLFW/glfw3.h>
+#include "replay_format.h"
+#include "../event_bus/event_bus.h"
+#include "../event_bus/events.h"
+
+/* Plays back a file written by InputRecorder. The clock of every frame comes
+ * from the file and the live GLFW input is ignored, so two replays of the same
+ * file run exactly the same workload. */
+class InputReplayer {
+public:
+    InputReplayer(const std::string &filename, GLFWwindow *window) {
+        m_window = window;
+        m_start_time = 0.0;
+        _load(filename);
+
+        /* Live input would make the replay diverge. */
+        if (window) {
+            glfwSetKeyCallback(window, NULL);
+            glfwSetMouseButtonCallback(window, NULL);
+            glfwSetCursorPosCallback(window, NULL);
+            glfwSetFramebufferSizeCallback(window, NULL);
+        }
+    }
+
+    unsigned long FrameCount() {
+        return m_frames.size();
+    }
+
+    double StartTime() {
+        return m_start_time;
+    }
+
+    double FrameTime(unsigned long frame) {
+        return m_frames[frame].time;
+    }
+
+    /* Publishes the events recorded for the frame, to be handled by the next Dispatch(). */
+    void PublishEvents(unsigned long frame) {
+        const Frame &f = m_frames[frame];
+        for (size_t i = 0; i < f.inputs.size(); i++) {
+            const Input &in = f.inputs[i];
+            switch (in.type) {
+                case 'K': {
+                    KeyEvent e = {m_window, in.a, in.b, in.c, in.d};
+                    EVENT_BUS.Publish(e);
+                    break;
+                }
+                case 'B': {
+                    MouseButtonEvent e = {m_window, in.a, in.b, in.c};
+                    EVENT_BUS.Publish(e);
+                    break;
+                }
+                case 'M': {
+                    MouseCursorEvent e = {m_window, in.x, in.y};
+                    EVENT_BUS.Publish(e);
+                    break;
+                }
+                case 'S': {
+                    /* The offscreen framebuffer keeps the --size of the command line. */
+                    if (!m_window)
+                        break;
+                    FrameBufferSizeEvent e = {m_window, in.a, in.b};
+                    EVENT_BUS.Publish(e);
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+
+    bool getCameraState(unsigned long frame, CameraState &state) {
+        if (!m_frames[frame].has_camera)
+            return false;
+        state = m_frames[frame].camera;
+        return true;
+    }
+
+private:
+    struct Input {
+        char type;
+        int a, b, c, d;
+        double x, y;
+    };
+
+    struct Frame {
+        double time;
+        std::vector<Input> inputs;
+        bool has_camera;
+        CameraState camera;
+    };
+
+    GLFWwindow *m_window;
+    double m_start_time;
+    std::vector<Frame> m_frames;
+
+    Frame &_frame(unsigned long index) {
+        if (index >= m_frames.size()) {
+            Frame empty;
+            empty.time = m_frames.empty() ? m_start_time : m_frames.back().time;
+            empty.has_camera = false;
+            m_frames.resize(index + 1, empty);
+        }
+        return m_frames[index];
+    }
+
+    void _load(const std::string &filename) {
+        std::ifstream in(filename.c_str());
+        if (!in) {
+            throw std::runtime_error("Could not open " + filename + " for replay");
+        }
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream ss(line);
+            char type;
+            unsigned long frame;
+            if (!(ss >> type))
+                continue;
+            if (type == 'R') {
+                ss >> m_start_time;
+                continue;
+            }
+            if (!(ss >> frame))
+                throw std::runtime_error("Malformed replay line : " + line);
+            Frame &f = _frame(frame);
+            Input input = {type, 0, 0, 0, 0, 0.0, 0.0};
+            switch (type) {
+                case 'F':
+                    ss >> f.time;
+                    break;
+                case 'K':
+                    ss >> input.a >> input.b >> input.c >> input.d;
+                    f.inputs.push_back(input);
+                    break;
+                case 'B':
+                    ss >> input.a >> input.b >> input.c;
+                    f.inputs.push_back(input);
+                    break;
+                case 'M':
+                    ss >> input.x >> input.y;
+                    f.inputs.push_back(input);
+                    break;
+                case 'S':
+                    ss >> input.a >> input.b;
+                    f.inputs.push_back(input);
+                    break;
+                case 'C':
+                    ss >> f.camera.position.x >> f.camera.position.y >> f.camera.position.z
+                    >> f.camera.rotation.x >> f.camera.rotation.y;
+                    f.has_camera = true;
+                    break;
+                default:
+                    throw std::runtime_error("Unknown replay record : " + line);
+            }
+            if (ss.fail())
+                throw std::runtime_error("Malformed replay line : " + line);
+        }
+    }
+};
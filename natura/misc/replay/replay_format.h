@@ -0,0 +1,17 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/* Input recording file, one record per line, the second field is always the frame index.
+ *   R <start time>                      first line, clock value before the first frame
+ *   F <frame> <time>                    simulated clock at the start of the frame
+ *   K <frame> <key> <scancode> <action> <mods>
+ *   B <frame> <button> <action> <mods>
+ *   M <frame> <x> <y>
+ *   S <frame> <width> <height>
+ *   C <frame> <px> <py> <pz> <rx> <ry>  camera state once the frame ticks are done */
+
+struct CameraState {
+    glm::vec3 position;
+    glm::vec2 rotation;
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../../config.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#define PROGRAM_CACHE_MKDIR(dir) _mkdir(dir)
+#else
+#include <sys/stat.h>
+#define PROGRAM_CACHE_MKDIR(dir) mkdir(dir, 0755)
+#endif
+
+/* Identifies the cache files, followed by the binary format and length. */
+#define PROGRAM_CACHE_MAGIC 0x4250534e
+
+/* Linked programs saved with glGetProgramBinary and reloaded with glProgramBinary.
+ * A file is keyed by a hash of the sources and of the driver vendor, renderer and
+ * version strings, so a driver update simply misses. A binary the driver rejects
+ * is deleted and the program compiled from source again.
+ * Programs must not be relinked after loading: attribute locations go in the
+ * GLSL (layout(location = ...)) and uniforms are set afterwards. */
+class ProgramCache {
+public:
+    /* Empty to disable the cache. */
+    void setDirectory(const std::string &directory) {
+        m_directory = directory;
+    }
+
+    /* Also creates the directory on first use. */
+    bool isEnabled() {
+        return _isSupported();
+    }
+
+    /* Program previously stored for these sources, 0 when absent or rejected by the driver. */
+    GLuint LoadBinary(const std::string &vertex, const std::string &fragment, const std::string &geometry) {
+        if (!_isSupported())
+            return 0;
+        GLuint program = _loadBinary(_path(vertex, fragment, geometry));
+        if (program)
+            m_hits++;
+        return program;
+    }
+
+    /* To be called before linking a program which will be stored. */
+    void PrepareLink(GLuint program) {
+        if (_isSupported())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    void StoreBinary(const std::string &vertex, const std::string &fragment, const std::string &geometry,
+                     GLuint program) {
+        if (!_isSupported())
+            return;
+        m_stored++;
+        _storeBinary(_path(vertex, fragment, geometry), program);
+    }
+
+    void Report(std::ostream &out) {
+        if (m_hits + m_stored + m_rejected == 0)
+            return;
+        out << "Program cache : " << m_hits << " programs loaded from " << m_directory << ", " << m_stored
+            << " stored, " << m_rejected << " binaries rejected" << std::endl;
+    }
+
+    static bool ReadFile(const char *filename, std::string &content) {
+        std::ifstream stream(filename, std::ios::in);
+        if (!stream.is_open()) {
+            printf("Could not open file: %s\n", filename);
+            return false;
+        }
+        content = std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+private:
+    std::string m_directory = SHADER_CACHE_DIR;
+    std::string m_driver;
+    int m_supported = -1;
+    unsigned long m_hits = 0;
+    unsigned long m_stored = 0;
+    unsigned long m_rejected = 0;
+
+    bool _isSupported() {
+        if (m_directory.empty())
+            return false;
+        if (m_supported < 0) {
+            GLint formats = 0;
+            if (glGetProgramBinary != NULL && glProgramBinary != NULL && glProgramParameteri != NULL)
+                glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            m_supported = formats > 0;
+            if (m_supported) {
+                m_driver = _glString(GL_VENDOR) + '\n' + _glString(GL_RENDERER) + '\n' + _glString(GL_VERSION);
+                PROGRAM_CACHE_MKDIR(m_directory.c_str());
+            }
+        }
+        return m_supported == 1;
+    }
+
+    static std::string _glString(GLenum name) {
+        const GLubyte *value = glGetString(name);
+        return value ? std::string((const char *) value) : std::string();
+    }
+
+    /* 64-bit FNV-1a, the sources are separated so that moving text between stages changes the key. */
+    static void _hash(uint64_t &hash, const std::string &text) {
+        for (size_t i = 0; i < text.size(); i++) {
+            hash ^= (unsigned char) text[i];
+            hash *= 1099511628211ull;
+        }
+        hash ^= 0xff;
+        hash *= 1099511628211ull;
+    }
+
+    std::string _path(const std::string &vertex, const std::string &fragment, const std::string &geometry) {
+        uint64_t hash = 14695981039346656037ull;
+        _hash(hash, m_driver);
+        _hash(hash, vertex);
+        _hash(hash, fragment);
+        _hash(hash, geometry);
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) hash);
+        return m_directory + "/" + name;
+    }
+
+    GLuint _loadBinary(const std::string &path) {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        if (!in.is_open())
+            return 0;
+        uint32_t header[3];
+        if (!in.read((char *) header, sizeof(header)) || header[0] != PROGRAM_CACHE_MAGIC) {
+            _reject(path);
+            return 0;
+        }
+        std::vector<char> binary(header[2]);
+        if (binary.empty() || !in.read(binary.data(), binary.size())) {
+            _reject(path);
+            return 0;
+        }
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, header[1], binary.data(), (GLsizei) binary.size());
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glDeleteProgram(program);
+            _reject(path);
+            return 0;
+        }
+        return program;
+    }
+
+    void _storeBinary(const std::string &path, GLuint program) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+        uint32_t header[3] = {PROGRAM_CACHE_MAGIC, format, (uint32_t) length};
+        out.write((const char *) header, sizeof(header));
+        out.write(binary.data(), length);
+        if (!out)
+            std::cerr << "Could not write the program binary " << path << std::endl;
+    }
+
+    void _reject(const std::string &path) {
+        m_rejected++;
+        remove(path.c_str());
+    }
+};
+
+ProgramCache PROGRAM_CACHE;
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "program_cache.h"
+#include "../gl_state/gl_state.h"
+#include "../gl_resource/gl_handle.h"
+#include "../profiling/cpu_profiler.h"
+
+/* From KHR_parallel_shader_compile, which the bundled GLEW predates. */
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+/* Every program of the game, compiled once per (vertex, fragment, geometry, defines)
+ * and shared by reference count.
+ * Compilation has two phases: Request() submits the sources and links without
+ * asking for the result, Get() waits for it. Requesting the programs early lets
+ * the driver compile them on its own threads (KHR_parallel_shader_compile, or
+ * the deferred compilation of most desktop drivers) while the textures load and
+ * the first chunks generate. Binaries go through PROGRAM_CACHE.
+ * Programs are kept until Cleanup() even when nothing references them, the
+ * next Ball fired must not compile the ball program again. */
+class ShaderLibrary {
+public:
+    void Init() {
+        m_parallel = false;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++) {
+            const char *name = (const char *) glGetStringi(GL_EXTENSIONS, i);
+            if (name && (!strcmp(name, "GL_KHR_parallel_shader_compile") ||
+                         !strcmp(name, "GL_ARB_parallel_shader_compile")))
+                m_parallel = true;
+        }
+    }
+
+    /* Starts compiling the program unless it is already known. */
+    void Request(const char *vshader, const char *fshader, const char *gshader = NULL,
+                 const std::string &defines = "") {
+        _request(_key(vshader, fshader, gshader, defines), vshader, fshader, gshader, defines);
+    }
+
+    /* Shared program, 0 if it failed to compile. Every Get() must be matched by a Release(). */
+    GLuint Get(const char *vshader, const char *fshader, const char *gshader = NULL,
+               const std::string &defines = "") {
+        PROFILE_SCOPE("ShaderLibrary::Get");
+        std::string key = _key(vshader, fshader, gshader, defines);
+        Entry &entry = _request(key, vshader, fshader, gshader, defines);
+        if (entry.pending)
+            _finish(entry);
+        if (!entry.program.isValid())
+            return 0;
+        if (entry.references++ > 0)
+            m_shared++;
+        m_keys[entry.program.getId()] = key;
+        return entry.program.getId();
+    }
+
+    void Release(GLuint program) {
+        std::map<GLuint, std::string>::iterator key = m_keys.find(program);
+        if (key == m_keys.end())
+            return;
+        std::map<std::string, Entry>::iterator entry = m_entries.find(key->second);
+        if (entry->second.references > 0)
+            entry->second.references--;
+    }
+
+    /* True when Get() would not wait. */
+    bool isReady(const char *vshader, const char *fshader, const char *gshader = NULL,
+                 const std::string &defines = "") {
+        std::map<std::string, Entry>::iterator it = m_entries.find(_key(vshader, fshader, gshader, defines));
+        if (it == m_entries.end())
+            return false;
+        if (!it->second.pending)
+            return true;
+        if (!m_parallel)
+            return false;
+        GLint done = GL_FALSE;
+        glGetProgramiv(it->second.program.getId(), GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+
+    void Report(std::ostream &out) {
+        out << "Shader library : " << m_entries.size() << " programs, " << m_compiled << " compiled"
+            << (m_parallel ? " (KHR_parallel_shader_compile)" : "") << ", " << m_shared << " shared references" << std::endl;
+    }
+
+    void Cleanup() {
+        for (std::map<std::string, Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+            if (it->second.pending)
+                _finish(it->second);
+        }
+        m_entries.clear();
+        m_keys.clear();
+    }
+
+    /* The #version directive must stay first, the defines go on the next line. */
+    static std::string InjectDefines(const std::string &source, const std::string &defines) {
+        if (defines.empty() || source.empty())
+            return source;
+        size_t version = source.find("#version");
+        if (version == std::string::npos)
+            return defines + source;
+        size_t line_end = source.find('\n', version);
+        if (line_end == std::string::npos)
+            return source + "\n" + defines;
+        return source.substr(0, line_end + 1) + defines + source.substr(line_end + 1);
+    }
+
+private:
+    struct Entry {
+        std::string name;
+        std::string sources[3];
+        GLuint shaders[3];
+        ProgramHandle program;
+        bool pending;
+        int references;
+    };
+
+    std::map<std::string, Entry> m_entries;
+    std::map<GLuint, std::string> m_keys;
+    bool m_parallel = false;
+    unsigned long m_compiled = 0;
+    unsigned long m_shared = 0;
+
+    static std::string _key(const char *vshader, const char *fshader, const char *gshader,
+                            const std::string &defines) {
+        return std::string(vshader) + '|' + fshader + '|' + (gshader ? gshader : "") + '|' + defines;
+    }
+
+    Entry &_request(const std::string &key, const char *vshader, const char *fshader, const char *gshader,
+                    const std::string &defines) {
+        std::map<std::string, Entry>::iterator it = m_entries.find(key);
+        if (it != m_entries.end())
+            return it->second;
+
+        Entry &entry = m_entries[key];
+        entry.name = std::string(vshader) + ", " + fshader + (gshader ? std::string(", ") + gshader : "");
+        entry.pending = false;
+        entry.references = 0;
+        for (int i = 0; i < 3; i++)
+            entry.shaders[i] = 0;
+
+        if (!ProgramCache::ReadFile(vshader, entry.sources[0]) || !ProgramCache::ReadFile(fshader, entry.sources[1]) ||
+            (gshader && !ProgramCache::ReadFile(gshader, entry.sources[2]))) {
+            return entry;
+        }
+        for (int i = 0; i < 3; i++)
+            entry.sources[i] = InjectDefines(entry.sources[i], defines);
+
+        entry.program.Reset(PROGRAM_CACHE.LoadBinary(entry.sources[0], entry.sources[1], entry.sources[2]));
+        if (!entry.program.isValid())
+            _start(entry);
+        return entry;
+    }
+
+    /* Submits the sources and links without querying any status, which would wait for the compiler. */
+    void _start(Entry &entry) {
+        static const GLenum types[3] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER};
+        GLuint program = entry.program.Create();
+        for (int i = 0; i < 3; i++) {
+            if (entry.sources[i].empty())
+                continue;
+            const char *source = entry.sources[i].c_str();
+            entry.shaders[i] = glCreateShader(types[i]);
+            glShaderSource(entry.shaders[i], 1, &source, NULL);
+            glCompileShader(entry.shaders[i]);
+            glAttachShader(program, entry.shaders[i]);
+        }
+        PROGRAM_CACHE.PrepareLink(program);
+        glLinkProgram(program);
+        entry.pending = true;
+        m_compiled++;
+    }
+
+    void _finish(Entry &entry) {
+        entry.pending = false;
+        GLuint program = entry.program.getId();
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            std::cerr << "Failed linking " << entry.name << std::endl;
+            for (int i = 0; i < 3; i++) {
+                if (entry.shaders[i])
+                    _printLog(entry.shaders[i], false);
+            }
+            _printLog(program, true);
+        } else {
+            PROGRAM_CACHE.StoreBinary(entry.sources[0], entry.sources[1], entry.sources[2], program);
+        }
+        for (int i = 0; i < 3; i++) {
+            if (entry.shaders[i]) {
+                glDetachShader(program, entry.shaders[i]);
+                glDeleteShader(entry.shaders[i]);
+                entry.shaders[i] = 0;
+            }
+        }
+        if (!success)
+            entry.program.Reset();
+    }
+
+    static void _printLog(GLuint object, bool program) {
+        GLint length = 0;
+        if (program)
+            glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+        else
+            glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+        if (length <= 1)
+            return;
+        std::vector<char> log(length);
+        if (program)
+            glGetProgramInfoLog(object, length, NULL, log.data());
+        else
+            glGetShaderInfoLog(object, length, NULL, log.data());
+        std::cerr << log.data() << std::endl;
+    }
+};
+
+ShaderLibrary SHADER_LIBRARY;
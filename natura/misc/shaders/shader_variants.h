@@ -0,0 +1,84 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "../gl_state/gl_state.h"
+#include "shader_library.h"
+
+/* A shader program compiled once per combination of features. Feature i is
+ * bit i of the mask and becomes "#define <name>" right after the #version
+ * line, so the GLSL can test it with #ifdef instead of branching on a uniform.
+ * Variants are compiled on first use, or ahead with Request(), and kept until Cleanup(). */
+class ShaderVariants {
+public:
+    /* Called with each new program bound, to set the constant uniforms. */
+    typedef std::function<void(GLuint)> SetupFunction;
+
+    ShaderVariants(const char *vshader, const char *fshader, const std::vector<std::string> &features,
+                   const char *gshader = NULL)
+            : m_vshader(vshader), m_fshader(fshader), m_gshader(gshader ? gshader : ""), m_features(features) { }
+
+    void setSetup(SetupFunction setup) {
+        m_setup = setup;
+    }
+
+    /* Starts compiling the variant in the background, see ShaderLibrary. */
+    void Request(uint32_t mask) {
+        SHADER_LIBRARY.Request(m_vshader.c_str(), m_fshader.c_str(), _gshader(), Defines(mask));
+    }
+
+    /* Program for the given feature mask, 0 if it failed to compile. */
+    GLuint Get(uint32_t mask) {
+        std::map<uint32_t, GLuint>::iterator it = m_programs.find(mask);
+        if (it != m_programs.end())
+            return it->second;
+
+        GLuint program = SHADER_LIBRARY.Get(m_vshader.c_str(), m_fshader.c_str(), _gshader(), Defines(mask));
+        if (!program)
+            std::cerr << "Failed to compile variant " << mask << " of " << m_vshader << std::endl;
+        else if (m_setup) {
+            GL_STATE.UseProgram(program);
+            m_setup(program);
+        }
+        m_programs[mask] = program;
+        return program;
+    }
+
+    size_t Size() {
+        return m_programs.size();
+    }
+
+    void Cleanup() {
+        for (std::map<uint32_t, GLuint>::iterator it = m_programs.begin(); it != m_programs.end(); ++it) {
+            if (it->second)
+                SHADER_LIBRARY.Release(it->second);
+        }
+        m_programs.clear();
+    }
+
+    /* One #define per set bit. */
+    std::string Defines(uint32_t mask) {
+        std::string defines;
+        for (size_t i = 0; i < m_features.size(); i++) {
+            if (mask & (1u << i))
+                defines += "#define " + m_features[i] + "\n";
+        }
+        return defines;
+    }
+
+private:
+    std::string m_vshader;
+    std::string m_fshader;
+    std::string m_gshader;
+    std::vector<std::string> m_features;
+    SetupFunction m_setup;
+    std::map<uint32_t, GLuint> m_programs;
+
+    const char *_gshader() {
+        return m_gshader.empty() ? NULL : m_gshader.c_str();
+    }
+};
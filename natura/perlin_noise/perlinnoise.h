@@ -1,47 +1,82 @@
 #pragma once
 
 #include <cstdint>
+#include <vector>
 #include <GL/glew.h>
-#include <deque>
 #include "../perlin_quad/perlin_quad.h"
 #include "../framebuffer.h"
-#include "../misc/observer_subject/subject.h"
-#include "../misc/observer_subject/messages/perlin_noise_prop_changed_message.h"
+#include "../config.h"
+#include "../misc/gl_resource/framebuffer_pool.h"
+#include "../misc/event_bus/event_bus.h"
+#include "../misc/event_bus/events.h"
+#include "../misc/profiling/gpu_timer.h"
+#include "../misc/profiling/cpu_profiler.h"
 
 enum class PerlinNoiseProperty {H, LACUNARITY, OFFSET, FREQUENCY, OCTAVE};
-class PerlinNoise : public Subject{
+class PerlinNoise {
 public:
-    PerlinNoise(uint32_t width, uint32_t height, glm::vec2 cache_size) {
+    PerlinNoise(uint32_t width, uint32_t height) {
         mWidth = width;
         mHeight = height;
-
-        for (int i = 0 ; i < cache_size.y ; i ++){
-            m_frame_buffers.push_back(std::deque<FrameBuffer> (static_cast<unsigned long> (cache_size.x), FrameBuffer()));
-        }
-        m_terrain_offset = glm::vec2(0,0);
     }
 
     void Init(){
-        for (int i = 0 ; i < m_frame_buffers.size() ; i ++){
-            for (int j = 0 ; j < m_frame_buffers[i].size() ; j ++){
-                m_frame_buffers[i][j].Init(mWidth, mHeight, GL_R32F);
-            }
-        }
         quad.Init();
+        m_height_samples.Init(HEIGHTFIELD_RESOLUTION, HEIGHTFIELD_RESOLUTION, GL_R32F, false, GPU_MEMORY_HEIGHTMAPS);
+    }
+
+    /* Heightmaps come from FRAMEBUFFER_POOL, give them back with releaseHeightmap().
+     * The second attachment receives the baked normals.
+     * Each heightmap covers its chunk plus a one texel apron on every side, so that the
+     * shaders can filter up to the chunk's edges without reading the neighbours :
+     * chunk coordinate t in [0, 1] is at texel t * (size - 2) + 1. */
+    FrameBuffer *acquireHeightmap() {
+        return FRAMEBUFFER_POOL.Acquire(mWidth, mHeight, GL_R32F, true, GPU_MEMORY_HEIGHTMAPS, GL_RGB10_A2);
+    }
+
+    /* Video memory of one heightmap with its attachments. */
+    size_t getHeightmapBytes() {
+        return GpuMemoryTracker::TextureBytes(GL_R32F, mWidth, mHeight) +
+               GpuMemoryTracker::TextureBytes(GL_RGB10_A2, mWidth, mHeight) +
+               GpuMemoryTracker::TextureBytes(GL_DEPTH_COMPONENT32, mWidth, mHeight);
+    }
+
+    void releaseHeightmap(FrameBuffer *frameBuffer) {
+        FRAMEBUFFER_POOL.Release(frameBuffer);
     }
 
-    int generateNoise(glm::vec2 displ) {
-        glm::vec2 id = displ  - m_terrain_offset;
-        FrameBuffer *frameBuffer = &m_frame_buffers[(int)id.y][(int)id.x];
+    int generateNoise(FrameBuffer *frameBuffer, glm::vec2 displ) {
+        PROFILE_SCOPE("PerlinNoise::generateNoise");
         int tex = frameBuffer->getTextureId();
 
+        GpuTimerScope gpu_scope("noise");
         frameBuffer->Bind();
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        quad.Draw(IDENTITY_MATRIX, m_H, m_frequency, m_lacunarity, m_offset, m_octaves, displ);
+        quad.Draw(IDENTITY_MATRIX, m_H, m_frequency, m_lacunarity, m_offset, m_octaves, displ, getApronScale());
         frameBuffer->Unbind();
         return tex;
     }
 
+    /* Size of the heightmap relative to its chunk. */
+    glm::vec2 getApronScale() {
+        return glm::vec2(mWidth / (mWidth - 2.f), mHeight / (mHeight - 2.f));
+    }
+
+    /* Evaluates the noise of the chunk at displ on a HEIGHTFIELD_RESOLUTION^2 grid whose
+     * first and last samples are on the chunk's edges, and reads it back.
+     * Small enough to stall on, unlike the full heightmap. */
+    void generateHeights(glm::vec2 displ, std::vector<float> &heights) {
+        PROFILE_SCOPE("PerlinNoise::generateHeights");
+        const int resolution = HEIGHTFIELD_RESOLUTION;
+        heights.resize(resolution * resolution);
+        m_height_samples.Bind();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        quad.Draw(IDENTITY_MATRIX, m_H, m_frequency, m_lacunarity, m_offset, m_octaves, displ,
+                  glm::vec2(resolution / (resolution - 1.f)));
+        glReadPixels(0, 0, resolution, resolution, GL_RED, GL_FLOAT, heights.data());
+        m_height_samples.Unbind();
+    }
+
     void setProperty(PerlinNoiseProperty prop, float value){
         switch (prop) {
             case PerlinNoiseProperty::H :
@@ -65,9 +100,7 @@ public:
                 break;
         }
         /* Notify the chunks. */
-        Message *m = new PerlinNoisePropChangedMessage();
-        notify(m);
-        delete m;
+        EVENT_BUS.Publish(PerlinNoisePropChangedEvent());
     }
 
     float getProperty(PerlinNoiseProperty prop){
@@ -89,55 +122,17 @@ public:
         }
     }
 
-    void setTerrainOffset(glm::vec2 offset){
-        glm::vec2 dir = m_terrain_offset - offset;
-        m_terrain_offset = offset;
-        if (dir.y > 0){
-            m_frame_buffers.push_front(m_frame_buffers[m_frame_buffers.size()-1]);
-            m_frame_buffers.pop_back();
-        }
-        else if (dir.y < 0){
-            m_frame_buffers.push_back(m_frame_buffers[0]);
-            m_frame_buffers.pop_front();
-        }
-        else if (dir.x < 0){
-            for (int i = 0 ; i < m_frame_buffers.size() ; i ++){
-                m_frame_buffers[i].push_back(m_frame_buffers[i][0]);
-                m_frame_buffers[i].pop_front();
-            }
-        }
-        else if (dir.x > 0){
-            for (int i = 0 ; i < m_frame_buffers.size() ; i ++){
-                m_frame_buffers[i].push_front(m_frame_buffers[i][m_frame_buffers.size()-1]);
-                m_frame_buffers[i].pop_back();
-            }
-        }
-    }
-
     void Cleanup() {
         quad.Cleanup();
-        for (int i = 0 ; i < m_frame_buffers.size() ; i ++){
-            for (int j = 0 ; j < m_frame_buffers[i].size() ; j ++){
-                m_frame_buffers[i][j].Cleanup();
-            }
-        }
-    }
-
-    FrameBuffer *getFrameBufferForChunk(glm::vec2 chunkpos){
-        int m = m_frame_buffers.size();
-        chunkpos.x = (int)chunkpos.x % m;
-        chunkpos.y = (int)chunkpos.y % m;
-        chunkpos.x = chunkpos.x < 0 ? chunkpos.x + m : chunkpos.x;
-        chunkpos.y = chunkpos.y < 0 ? chunkpos.y + m : chunkpos.y;
-        return &m_frame_buffers[(int)chunkpos.y][(int)chunkpos.x];
+        m_height_samples.Cleanup();
     }
 
 private:
-    std::deque<std::deque<FrameBuffer> > m_frame_buffers;
-    glm::vec2 m_terrain_offset;
     uint32_t mWidth;
     uint32_t mHeight;
     PerlinQuad quad;
+    /* Target of generateHeights(). */
+    FrameBuffer m_height_samples;
     float m_H = 0.35f;
     float m_lacunarity = 2.5f;
     float m_offset = 0.2f;
@@ -2,14 +2,16 @@
 
 #include "icg_helper.h"
 #include "glm/gtc/type_ptr.hpp"
+#include "../misc/gl_state/gl_state.h"
+#include "../misc/shaders/shader_library.h"
+#include "../misc/gl_resource/gl_handle.h"
 
 class PerlinQuad {
 
 private:
-    GLuint vertex_array_id_;        // vertex array object
-    GLuint program_id_;             // GLSL shader program ID
-    GLuint vertex_buffer_object_;   // memory buffer
-    GLuint texture_id_;             // texture ID
+    VertexArrayHandle vertex_array_id_;     // vertex array object
+    GLuint program_id_;                     // GLSL shader program ID
+    BufferHandle vertex_buffer_object_;     // memory buffer
 
     int p_[256] = {173, 78, 203, 128, 97, 146, 63, 65, 159, 43, 212, 48, 34, 171, 183, 197,
     170, 69, 103, 216, 167, 208, 189, 93, 228, 49, 226, 59, 96, 156, 1, 72, 182, 188, 83, 166, 179, 143,
@@ -28,17 +30,16 @@ public:
 
     void Init() {
         // compile the shaders
-        program_id_ = icg_helper::LoadShaders("perlin_quad_vshader.glsl",
-                                              "perlin_quad_fshader.glsl");
+        program_id_ = SHADER_LIBRARY.Get("perlin_quad_vshader.glsl",
+                                         "perlin_quad_fshader.glsl");
         if (!program_id_) {
             exit(EXIT_FAILURE);
         }
 
-        glUseProgram(program_id_);
+        GL_STATE.UseProgram(program_id_);
 
         // vertex one vertex Array
-        glGenVertexArrays(1, &vertex_array_id_);
-        glBindVertexArray(vertex_array_id_);
+        GL_STATE.BindVertexArray(vertex_array_id_.Create());
 
         // vertex coordinates
         {
@@ -47,10 +48,11 @@ public:
                     /*V3*/ -1.0f, +1.0f, 0.0f,
                     /*V4*/ +1.0f, +1.0f, 0.0f};
             // buffer
-            glGenBuffers(1, &vertex_buffer_object_);
-            glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
+            glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_.Create());
             glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_point),
                          vertex_point, GL_STATIC_DRAW);
+            GPU_MEMORY.Allocate(GPU_OBJECT_BUFFER, vertex_buffer_object_.getId(), GPU_MEMORY_GEOMETRY,
+                                sizeof(vertex_point));
 
             // attribute
             GLuint vertex_point_id = glGetAttribLocation(program_id_, "vpoint");
@@ -60,22 +62,22 @@ public:
         }
 
         // to avoid the current object being polluted
-        glBindVertexArray(0);
-        glUseProgram(0);
+        GL_STATE.BindVertexArray(0);
+        GL_STATE.UseProgram(0);
     }
 
     void Cleanup() {
-        glBindVertexArray(0);
-        glUseProgram(0);
-        glDeleteBuffers(1, &vertex_buffer_object_);
-        glDeleteProgram(program_id_);
-        glDeleteVertexArrays(1, &vertex_array_id_);
-        glDeleteTextures(1, &texture_id_);
+        GL_STATE.BindVertexArray(0);
+        GL_STATE.UseProgram(0);
+        vertex_buffer_object_.Reset();
+        SHADER_LIBRARY.Release(program_id_);
+        vertex_array_id_.Reset();
     }
 
-    void Draw(const glm::mat4 &MVP, float H, float frequency, float lacunarity, float offset, int octaves, glm::vec2 displ) {
-        glUseProgram(program_id_);
-        glBindVertexArray(vertex_array_id_);
+    void Draw(const glm::mat4 &MVP, float H, float frequency, float lacunarity, float offset, int octaves, glm::vec2 displ,
+              glm::vec2 apron_scale = glm::vec2(1.0f)) {
+        GL_STATE.UseProgram(program_id_);
+        GL_STATE.BindVertexArray(vertex_array_id_.getId());
 
 
         // setup MVP
@@ -88,11 +90,11 @@ public:
         glUniform1f(glGetUniformLocation(program_id_, "offset"), offset);
         glUniform1i(glGetUniformLocation(program_id_, "octaves"), octaves);
         glUniform2fv(glGetUniformLocation(program_id_, "displacement"), ONE, glm::value_ptr(displ));
+        glUniform2fv(glGetUniformLocation(program_id_, "apron_scale"), ONE, glm::value_ptr(apron_scale));
         glUniform1iv(glGetUniformLocation(program_id_, "p"), 256, p_);
+        GL_STATE.Disable(GL_BLEND);
+
         // draw
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-
-        glBindVertexArray(0);
-        glUseProgram(0);
     }
 };
@@ -2,9 +2,16 @@
 
 in vec2 uv;
 
-out vec3 color;
+layout(location = 0) out vec3 color;
+/* Terrain normal packed in [0, 1], for the heightmap's second attachment. */
+layout(location = 1) out vec3 normal;
+
+/* Offset of the height differences, in heightmap texture coordinates (uv spans twice that). */
+#define NORMAL_EPSILON 0.005
 
 uniform vec2 displacement;
+/* The quad spans the chunk and its apron : size / (size - 2) of the chunk on each axis. */
+uniform vec2 apron_scale;
 uniform float frequency ;
 uniform float H;
 uniform float offset;
@@ -97,6 +104,14 @@ float multifractal(vec2 point) {
 }
 
 void main(){
-    vec2 point = vec2((uv[0]+displacement.x*2), (uv[1]+displacement.y*2));
+    vec2 point = uv * apron_scale + displacement * 2;
     color = vec3(multifractal(point), 0.0f, 0.0f);
+
+    /* Central differences, the same the terrain shader used to take on the heightmap.
+     * The noise is continuous across chunks so the borders need no neighbour. */
+    vec2 du = vec2(2.0 * NORMAL_EPSILON, 0.0);
+    vec2 dv = vec2(0.0, 2.0 * NORMAL_EPSILON);
+    float diff_x = multifractal(point + du) - multifractal(point - du);
+    float diff_y = multifractal(point + dv) - multifractal(point - dv);
+    normal = normalize(vec3(-diff_x, 2.0 * NORMAL_EPSILON, -diff_y)) * 0.5 + 0.5;
 }
\ No newline at end of file
@@ -4,15 +4,23 @@
 #include <GLFW/glfw3.h>
 #include "icg_helper.h"
 #include "../physics/material_point.h"
-#include "../misc/observer_subject/messages/ball_out_of_bound_message.h"
+#include "../misc/event_bus/event_bus.h"
+#include "../misc/event_bus/events.h"
+#include "../misc/profiling/cpu_profiler.h"
+#include "../misc/gl_state/gl_state.h"
+#include "../misc/profiling/gpu_memory.h"
+#include "../misc/shaders/shader_library.h"
+#include "../render_queue/render_queue.h"
 
-class Ball : public MaterialPoint, public Subject{
+class Ball : public MaterialPoint {
 
 public:
     Ball(glm::vec3 starting_position, glm::vec3 starting_vector, Terrain *terrain) : MaterialPoint(2.3f, starting_position) {
+        PROFILE_SCOPE("Ball::Ball");
         m_terrain = terrain;
         m_speed = 0.4f * starting_vector;
         m_frozen = false;
+        m_frozen_ticks = 0;
         this->setAccelerationVector(glm::vec3(0, -1.0f, 0));
 
         string error;
@@ -41,34 +49,39 @@ public:
 
         // vertex one vertex Array
         glGenVertexArrays(1, &m_vertex_array_id);
-        glBindVertexArray(m_vertex_array_id);
+        GL_STATE.BindVertexArray(m_vertex_array_id);
 
         // vertex buffer
         glGenBuffers(ONE, &m_vertex_buffer_object);
         glBindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer_object);
         glBufferData(GL_ARRAY_BUFFER, number_of_vertices * sizeof(float),
                      &m_shapes[0].mesh.positions[0], GL_STATIC_DRAW);
+        GPU_MEMORY.Allocate(GPU_OBJECT_BUFFER, m_vertex_buffer_object, GPU_MEMORY_GEOMETRY,
+                            number_of_vertices * sizeof(float));
 
         // normal buffer
         glGenBuffers(ONE, &m_vertex_normal_buffer_object);
         glBindBuffer(GL_ARRAY_BUFFER, m_vertex_normal_buffer_object);
         glBufferData(GL_ARRAY_BUFFER, number_of_normals * sizeof(float),
                      &m_shapes[0].mesh.normals[0], GL_STATIC_DRAW);
+        GPU_MEMORY.Allocate(GPU_OBJECT_BUFFER, m_vertex_normal_buffer_object, GPU_MEMORY_GEOMETRY,
+                            number_of_normals * sizeof(float));
 
         // index buffer
-        GLuint vertex_buffer_object_indices;
-        glGenBuffers(ONE, &vertex_buffer_object_indices);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertex_buffer_object_indices);
+        glGenBuffers(ONE, &m_index_buffer_object);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer_object);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                      number_of_indices * sizeof(unsigned int),
                      &m_shapes[0].mesh.indices[0], GL_STATIC_DRAW);
+        GPU_MEMORY.Allocate(GPU_OBJECT_BUFFER, m_index_buffer_object, GPU_MEMORY_GEOMETRY,
+                            number_of_indices * sizeof(unsigned int));
 
-        glBindVertexArray(0);
+        GL_STATE.BindVertexArray(0);
 
-        m_program_id = icg_helper::LoadShaders("ball_vshader.glsl",
-                                               "ball_fshader.glsl");
+        m_program_id = SHADER_LIBRARY.Get("ball_vshader.glsl",
+                                          "ball_fshader.glsl");
 
-        glUseProgram(m_program_id);
+        GL_STATE.UseProgram(m_program_id);
 
         glm::vec3 ka = glm::vec3(0.5f, 0.1f, 0.1f);
         glm::vec3 kd = glm::vec3(0.9f, 0.5f, 0.5f);
@@ -100,15 +113,17 @@ public:
     }
 
     void tick(glm::vec3 referencePoint) {
+        PROFILE_SCOPE("Ball::tick");
         if (length(m_speed) < 0.01f || m_frozen) {
             if (!m_frozen){
                 m_frozen = true;
-                m_froze_time = glfwGetTime();
+                m_frozen_ticks = 0;
             }
             else{
-                double time = glfwGetTime();
-                if (time - m_froze_time > BALL_MAX_FROZEN_TIME){
-                    notify(new BallOutOfBoundsMessage(this));
+                /* Counted in ticks so that a replay removes the ball on the same frame. */
+                m_frozen_ticks++;
+                if (m_frozen_ticks * TICK > BALL_MAX_FROZEN_TIME){
+                    _publishOutOfBounds();
                 }
             }
         }
@@ -142,29 +157,63 @@ public:
             }
             catch (std::runtime_error e){
                 /* Need to destroy the ball. */
-                notify(new BallOutOfBoundsMessage(this));
+                _publishOutOfBounds();
             }
         }
     }
 
+    /* Resolves the contact with another ball (same mass, slightly inelastic). */
+    void collideWith(Ball &other) {
+        glm::vec3 delta = other.m_position - m_position;
+        float dist = length(delta);
+        float min_dist = 2.f * BALL_RADIUS;
+        if (dist >= min_dist || dist == 0.f)
+            return;
+        glm::vec3 normal = delta / dist;
+
+        /* Push the balls apart so they stop overlapping. */
+        glm::vec3 correction = 0.5f * (min_dist - dist) * normal;
+        m_position -= correction;
+        other.m_position += correction;
+
+        float approach = dot(m_speed - other.m_speed, normal);
+        if (approach > 0.f) {
+            const float restitution = 0.8f;
+            glm::vec3 impulse = 0.5f * (1.f + restitution) * approach * normal;
+            m_speed -= impulse;
+            other.m_speed += impulse;
+            m_frozen = false;
+            other.m_frozen = false;
+            /* A resting ball may have dropped its gravity, give it back. */
+            setAccelerationVector(glm::vec3(0, -1.0f, 0));
+            other.setAccelerationVector(glm::vec3(0, -1.0f, 0));
+        }
+    }
+
     void CleanUp() {
-        glBindVertexArray(0);
-        glUseProgram(0);
+        GL_STATE.BindVertexArray(0);
+        GL_STATE.UseProgram(0);
+        GPU_MEMORY.Free(GPU_OBJECT_BUFFER, m_vertex_buffer_object);
+        GPU_MEMORY.Free(GPU_OBJECT_BUFFER, m_vertex_normal_buffer_object);
+        GPU_MEMORY.Free(GPU_OBJECT_BUFFER, m_index_buffer_object);
         glDeleteBuffers(1, &m_vertex_buffer_object);
         glDeleteBuffers(1, &m_vertex_normal_buffer_object);
-        glDeleteVertexArrays(1, &m_vertex_array_id);
+        glDeleteBuffers(1, &m_index_buffer_object);
+        GL_STATE.DeleteVertexArrays(1, &m_vertex_array_id);
+        SHADER_LIBRARY.Release(m_program_id);
     }
 
     void Draw(const glm::mat4 &model = IDENTITY_MATRIX,
               const glm::mat4 &view = IDENTITY_MATRIX,
-              const glm::mat4 &projection = IDENTITY_MATRIX) {
+              const glm::mat4 &projection = IDENTITY_MATRIX,
+              float alpha = 1.f) {
 
         glm::mat4 M = model;
-        M = glm::translate(model, m_position);
+        M = glm::translate(model, getInterpolatedPosition(alpha));
         M = glm::scale(M, glm::vec3(0.1f));
 
-        glUseProgram(m_program_id);
-        glBindVertexArray(m_vertex_array_id);
+        GL_STATE.UseProgram(m_program_id);
+        GL_STATE.BindVertexArray(m_vertex_array_id);
 
         GLint vertex_point_id = glGetAttribLocation(m_program_id, "vpoint");
         if (vertex_point_id >= 0) {
@@ -193,21 +242,29 @@ public:
         GLint projection_id = glGetUniformLocation(m_program_id, "projection");
         glUniformMatrix4fv(projection_id, ONE, DONT_TRANSPOSE, glm::value_ptr(projection));
 
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glUniform2fv(glGetUniformLocation(m_program_id, "fog_range"), ONE, glm::value_ptr(m_fog_range));
+
+        GL_STATE.Enable(GL_BLEND);
+        GL_STATE.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         glDrawElements(GL_TRIANGLES, /*#vertices*/ m_shapes[0].mesh.indices.size(),
                        GL_UNSIGNED_INT, ZERO_BUFFER_OFFSET);
 
-        glDisable(GL_BLEND);
-
         vertex_point_id = glGetAttribLocation(m_program_id, "vpoint");
         if (vertex_point_id >= 0) {
             glDisableVertexAttribArray(vertex_point_id);
         }
+    }
 
-        glUseProgram(0);
-        glBindVertexArray(0);
+    void Submit(RenderQueue &queue, const glm::mat4 &model, const glm::mat4 &view, float alpha) {
+        DrawPacket packet;
+        packet.draw = &Ball::_draw;
+        packet.object = this;
+        packet.model = model;
+        packet.params = glm::vec4(alpha, 0, 0, 0);
+        float depth = RenderQueue::ViewDepth(view, model, getInterpolatedPosition(alpha));
+        packet.key = RenderQueue::OpaqueKey(RENDER_PASS_BALLS, m_program_id, 0, depth);
+        queue.Submit(packet);
     }
 
 private:
@@ -215,10 +272,23 @@ private:
     std::vector<tinyobj::shape_t> m_shapes;
     GLuint m_vertex_buffer_object;           // memory buffer
     GLuint m_vertex_normal_buffer_object;    // memory buffer
+    GLuint m_index_buffer_object;            // memory buffer
     GLuint m_vertex_array_id;                // vertex array object
     GLuint m_program_id;
     bool m_frozen;
-    float m_froze_time;
+    int m_frozen_ticks;
     Terrain *m_terrain;
+    glm::vec2 m_fog_range;
+
+    static void _draw(const DrawPacket &packet, const RenderContext &context) {
+        Ball *ball = (Ball *) packet.object;
+        ball->m_fog_range = context.fog_range;
+        ball->Draw(packet.model, context.view, context.projection, packet.params.x);
+    }
+
+    void _publishOutOfBounds() {
+        BallOutOfBoundsEvent e = {this};
+        EVENT_BUS.Publish(e);
+    }
 };
 
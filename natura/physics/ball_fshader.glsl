@@ -1,6 +1,4 @@
 #version 330
-#define min_fog_distance 30.0f
-#define max_fog_distance 40.0f
 
 in vec3 normal_mv;
 in vec3 view_dir;
@@ -10,6 +8,7 @@ in float distance_camera;
 
 out vec4 color;
 
+uniform vec2 fog_range;  // start and end of the fog
 uniform vec3 La, Ld, Ls;
 uniform vec3 ka, kd, ks;
 uniform float alpha;
@@ -25,7 +24,7 @@ void main() {
     r = normalize(r);
     float dotRv = dot(r, view_dir) < 0.0f ? 0.0f : dot(r, view_dir);
 
-    float fog_factor = (max_fog_distance - distance_camera) / (max_fog_distance - min_fog_distance);
+    float fog_factor = (fog_range.y - distance_camera) / (fog_range.y - fog_range.x);
     fog_factor = clamp(fog_factor, 0.0f, 1.0f);
 
     vec3 specular = ks * pow(dotRv, alpha) * Ls;
@@ -9,9 +9,23 @@ public:
 
     MaterialPoint(float max_speed, glm::vec3 initial_pos = glm::vec3(0, 0, 0)) : m_acceleration(0, 0, 0), m_speed(0, 0, 0) {
         m_position = initial_pos;
+        m_previous_position = initial_pos;
         m_max_speed = max_speed;
     }
 
+    /* Polymorphic through tick(), the game deletes its balls by pointer. */
+    virtual ~MaterialPoint() {}
+
+    /* Must be called before every tick so that rendering can interpolate between the two last states. */
+    void savePreviousState() {
+        m_previous_position = m_position;
+    }
+
+    /* alpha = 0 gives the state before the last tick, alpha = 1 the current one. */
+    glm::vec3 getInterpolatedPosition(float alpha) {
+        return glm::mix(m_previous_position, m_position, alpha);
+    }
+
     glm::vec3 getPosition() {
         return m_position;
     }
@@ -72,6 +86,7 @@ protected:
     glm::vec3 m_acceleration;
     glm::vec3 m_speed;
     glm::vec3 m_position;
+    glm::vec3 m_previous_position;
 
     void _update_pos() {
         m_speed += 0.01f * glm::vec3(m_acceleration.x,
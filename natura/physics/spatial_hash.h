@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <glm/glm.hpp>
+
+/* Uniform grid broadphase. Bodies are bucketed by the cell containing their
+ * center, the entries are kept sorted by cell key so that a rebuild is a
+ * single sort and a lookup is a binary search (no allocation once warmed up).
+ * The cell size should be at least the diameter of the biggest body. */
+template<typename T>
+class SpatialHash {
+public:
+    SpatialHash(float cell_size) {
+        m_cell_size = cell_size;
+        m_max_radius = 0.f;
+    }
+
+    void Clear() {
+        m_entries.clear();
+        m_max_radius = 0.f;
+    }
+
+    void Insert(T *body, glm::vec3 position, float radius) {
+        Entry e;
+        e.key = _key(_cell(position));
+        e.body = body;
+        e.position = position;
+        e.radius = radius;
+        m_entries.push_back(e);
+        m_max_radius = std::max(m_max_radius, radius);
+    }
+
+    /* Must be called after the last Insert() and before any query. */
+    void Build() {
+        std::sort(m_entries.begin(), m_entries.end(),
+                  [](const Entry &a, const Entry &b) { return a.key < b.key; });
+    }
+
+    /* Appends to result every body whose sphere intersects the given sphere. */
+    void Query(glm::vec3 center, float radius, std::vector<T *> &result) const {
+        float reach = radius + m_max_radius;
+        glm::ivec3 lo = _cell(center - glm::vec3(reach));
+        glm::ivec3 hi = _cell(center + glm::vec3(reach));
+        for (int x = lo.x; x <= hi.x; x++) {
+            for (int y = lo.y; y <= hi.y; y++) {
+                for (int z = lo.z; z <= hi.z; z++) {
+                    size_t begin, end;
+                    _range(_key(glm::ivec3(x, y, z)), begin, end);
+                    for (size_t i = begin; i < end; i++) {
+                        float r = radius + m_entries[i].radius;
+                        glm::vec3 d = m_entries[i].position - center;
+                        if (glm::dot(d, d) <= r * r)
+                            result.push_back(m_entries[i].body);
+                    }
+                }
+            }
+        }
+    }
+
+    /* Calls callback(a, b) once for every pair of overlapping bodies. */
+    template<typename F>
+    void ForEachPair(F callback) const {
+        int span = (int) std::ceil(2.f * m_max_radius / m_cell_size);
+        for (size_t i = 0; i < m_entries.size(); i++) {
+            const Entry &a = m_entries[i];
+            glm::ivec3 c = _cell(a.position);
+            for (int x = c.x - span; x <= c.x + span; x++) {
+                for (int y = c.y - span; y <= c.y + span; y++) {
+                    for (int z = c.z - span; z <= c.z + span; z++) {
+                        size_t begin, end;
+                        _range(_key(glm::ivec3(x, y, z)), begin, end);
+                        /* Entries are sorted so only looking forward reports each pair once. */
+                        for (size_t j = std::max(begin, i + 1); j < end; j++) {
+                            const Entry &b = m_entries[j];
+                            float r = a.radius + b.radius;
+                            glm::vec3 d = b.position - a.position;
+                            if (glm::dot(d, d) <= r * r)
+                                callback(a.body, b.body);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    size_t Size() const {
+        return m_entries.size();
+    }
+
+private:
+    struct Entry {
+        uint64_t key;
+        T *body;
+        glm::vec3 position;
+        float radius;
+    };
+
+    std::vector<Entry> m_entries;
+    float m_cell_size;
+    float m_max_radius;
+
+    glm::ivec3 _cell(glm::vec3 pos) const {
+        return glm::ivec3((int) std::floor(pos.x / m_cell_size),
+                          (int) std::floor(pos.y / m_cell_size),
+                          (int) std::floor(pos.z / m_cell_size));
+    }
+
+    /* 21 bits per axis, which is plenty for a world that is a few thousand cells wide. */
+    static uint64_t _key(glm::ivec3 cell) {
+        const uint64_t mask = (1ull << 21) - 1;
+        const int64_t bias = 1 << 20;
+        return (((uint64_t) (cell.x + bias) & mask) << 42) |
+               (((uint64_t) (cell.y + bias) & mask) << 21) |
+               ((uint64_t) (cell.z + bias) & mask);
+    }
+
+    void _range(uint64_t key, size_t &begin, size_t &end) const {
+        Entry probe;
+        probe.key = key;
+        auto cmp = [](const Entry &a, const Entry &b) { return a.key < b.key; };
+        auto range = std::equal_range(m_entries.begin(), m_entries.end(), probe, cmp);
+        begin = range.first - m_entries.begin();
+        end = range.second - m_entries.begin();
+    }
+};
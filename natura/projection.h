@@ -26,6 +26,12 @@ public :
         projection[3][2] = -2 * mFar * mNear / (mFar - mNear);
         projection[2][3] = -1;
         mProjection = projection;
+        return mProjection;
+    }
+
+    void setFar(float far) {
+        mFar = far;
+        reGenerateMatrix(mAspect);
     }
 
     glm::mat4 perspective() {
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <glm/glm.hpp>
+#include "../misc/profiling/gpu_timer.h"
+
+/* Buckets executed in this order, they form the top bits of the sort key. */
+enum RenderPass {
+    RENDER_PASS_SKY = 0,
+    RENDER_PASS_TERRAIN = 1,
+    RENDER_PASS_GRASS = 2,
+    RENDER_PASS_WATER = 3,
+    RENDER_PASS_BALLS = 4,
+    RENDER_PASS_COUNT
+};
+
+/* Values shared by every packet of a flush. */
+struct RenderContext {
+    glm::mat4 view;
+    glm::mat4 projection;
+    float amplitude;
+    float time;
+    float water_height;
+    /* Distances where the fog starts and where it hides everything. */
+    glm::vec2 fog_range;
+};
+
+struct DrawPacket;
+typedef void (*DrawFunction)(const DrawPacket &packet, const RenderContext &context);
+
+/* One draw call: what to call, on which object, with which parameters. */
+struct DrawPacket {
+    uint64_t key;
+    DrawFunction draw;
+    void *object;
+    glm::mat4 model;
+    glm::vec4 params;
+    GLuint textures[4];
+};
+
+/* Renderables submit packets, Flush() sorts them by key and executes them so
+ * that each pass draws all its geometry together with as few program and
+ * texture switches as possible.
+ *
+ * Opaque key :      pass (4) | program (12) | material (16) | depth (32), front to back
+ * Transparent key : pass (4) | inverted depth (32) | program (12) | material (16), back to front */
+class RenderQueue {
+public:
+    static uint64_t OpaqueKey(RenderPass pass, GLuint program, GLuint material, float depth) {
+        return ((uint64_t) pass << 60) | ((uint64_t) (program & 0xFFF) << 48) |
+               ((uint64_t) (material & 0xFFFF) << 32) | _depthBits(depth);
+    }
+
+    static uint64_t TransparentKey(RenderPass pass, GLuint program, GLuint material, float depth) {
+        return ((uint64_t) pass << 60) | ((uint64_t) (~_depthBits(depth) & 0xFFFFFFFF) << 28) |
+               ((uint64_t) (program & 0xFFF) << 16) | (material & 0xFFFF);
+    }
+
+    /* Distance along the view direction of a point given in model space. */
+    static float ViewDepth(const glm::mat4 &view, const glm::mat4 &model, glm::vec3 point) {
+        return -(view * model * glm::vec4(point, 1.f)).z;
+    }
+
+    void Submit(const DrawPacket &packet) {
+        m_packets.push_back(packet);
+    }
+
+    size_t Size() {
+        return m_packets.size();
+    }
+
+    void Clear() {
+        m_packets.clear();
+    }
+
+    /* Sorts, executes and clears the queue. Each pass is timed on the GPU as
+     * "<scope>/<pass>", the shadow, reflection and main flushes are measured apart. */
+    void Flush(const RenderContext &context, const std::string &scope) {
+        m_order.resize(m_packets.size());
+        for (size_t i = 0; i < m_packets.size(); i++) {
+            m_order[i].key = m_packets[i].key;
+            m_order[i].index = (uint32_t) i;
+        }
+        std::sort(m_order.begin(), m_order.end());
+
+        static const char *pass_names[RENDER_PASS_COUNT] = {"skybox", "terrain", "grass", "water", "balls"};
+        int current_pass = -1;
+        int gpu_handle = -1;
+        for (size_t i = 0; i < m_order.size(); i++) {
+            const DrawPacket &packet = m_packets[m_order[i].index];
+            int pass = (int) (packet.key >> 60);
+            if (pass != current_pass) {
+                GPU_TIMER.End(gpu_handle);
+                gpu_handle = pass < RENDER_PASS_COUNT ? GPU_TIMER.Begin((scope + "/" + pass_names[pass]).c_str()) : -1;
+                current_pass = pass;
+            }
+            packet.draw(packet, context);
+        }
+        GPU_TIMER.End(gpu_handle);
+        Clear();
+    }
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        uint32_t index;
+
+        /* The index keeps the submission order of equal keys. */
+        bool operator<(const SortEntry &other) const {
+            return key < other.key || (key == other.key && index < other.index);
+        }
+    };
+
+    std::vector<DrawPacket> m_packets;
+    std::vector<SortEntry> m_order;
+
+    /* Non negative floats compare like their bit patterns. */
+    static uint64_t _depthBits(float depth) {
+        if (!(depth > 0.f))
+            depth = 0.f;
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        return bits;
+    }
+};
@@ -1,7 +1,7 @@
 #version 330
 #define noise_size 4.0f
 
-in vec2 position;
+layout(location = 0) in vec2 position; /* ATTRIB_LOC_position */
 
 out vec2 uv;
 uniform vec2 quad_indices;
@@ -13,15 +13,8 @@ uniform float water_height;
 uniform vec3 light_pos;
 uniform vec3 cam_pos;
 uniform vec2 chunk_pos;
-uniform int terrain_size; /* Size of terrain in chunks. */
 
 uniform sampler2D perlin_tex;
-uniform sampler2D left_tex;
-uniform bool left_present;
-uniform sampler2D low_tex;
-uniform bool low_present;
-uniform sampler2D low_left_tex;
-uniform bool low_left_present;
 uniform mat4 depth_vp_offset;
 
 
@@ -31,25 +24,36 @@ out float distance_camera;
 out mat4 MV;
 out vec4 shadow_coord;
 
-/* Sampler2D are opaque types so this function is handy to avoid duplication. */
+/* Heightmaps carry a one texel apron around the chunk, see PerlinNoise. */
+vec2 heightmapCoord(vec2 pos){
+    vec2 size = vec2(textureSize(perlin_tex, 0));
+    return (pos * (size - 2.0) + 1.0) / size;
+}
+
+/* Pushing the border of the terrain down prevents the light coming 'under' it.
+ * The BORDER_* defines are set for the chunks on the matching edge. */
 float getTextureVal(vec2 pos){
-    if (chunk_pos.x == 0 && pos.x == 0){
-        /* This is actually a trick to prevent the light coming 'under' the terrain.
-        */
-            return -100.0;
+#ifdef BORDER_X_MIN
+    if (pos.x == 0){
+        return -100.0;
     }
-    else if (chunk_pos.y == 0 && pos.y == 0){
+#endif
+#ifdef BORDER_Y_MIN
+    if (pos.y == 0){
         return -100.0;
     }
-    else if (chunk_pos.x == terrain_size-1 && pos.x == 1.0){
-            return -100.0;
-        }
-    else if (chunk_pos.y == terrain_size-1 && pos.y == 1.0){
+#endif
+#ifdef BORDER_X_MAX
+    if (pos.x == 1.0){
         return -100.0;
     }
-    else {
-        return texture(perlin_tex, pos).r;
+#endif
+#ifdef BORDER_Y_MAX
+    if (pos.y == 1.0){
+        return -100.0;
     }
+#endif
+    return texture(perlin_tex, heightmapCoord(pos)).r;
 }
 
 void main() {
@@ -1,5 +1,8 @@
 #pragma once
 #include "icg_helper.h"
+#include "../config.h"
+#include "../misc/gl_state/gl_state.h"
+#include "../misc/gl_resource/gl_handle.h"
 
 class ShadowBuffer {
 
@@ -7,8 +10,8 @@ class ShadowBuffer {
         bool init_;
         int width_;
         int height_;
-        GLuint frame_buffer_object_;
-        GLuint depth_texture_;
+        FramebufferHandle frame_buffer_object_;
+        TextureHandle depth_texture_;
         GLint previous_viewport_[4];
 
     public:
@@ -21,12 +24,12 @@ class ShadowBuffer {
         void Bind() {
             // Store the previous viewport
             glGetIntegerv(GL_VIEWPORT, previous_viewport_);
-            glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer_object_);
+            glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer_object_.getId());
             glViewport(0, 0, width_, height_);
         }
 
         void Unbind() {
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glBindFramebuffer(GL_FRAMEBUFFER, DEFAULT_FRAMEBUFFER);
             // Reset the viewport
             glViewport(previous_viewport_[0], previous_viewport_[1],
                     previous_viewport_[2], previous_viewport_[3]);
@@ -35,12 +38,13 @@ class ShadowBuffer {
         int Init() {
             // create color attachment
             {
-                glActiveTexture(GL_TEXTURE1);
-                glGenTextures(1, &depth_texture_);
-                glBindTexture(GL_TEXTURE_2D, depth_texture_);
+                GL_STATE.ActiveTexture(GL_TEXTURE1);
+                GL_STATE.BindTexture(GL_TEXTURE_2D, depth_texture_.Create());
 
                 glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width_,
                              height_, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+                GPU_MEMORY.Allocate(GPU_OBJECT_TEXTURE, depth_texture_.getId(), GPU_MEMORY_SHADOW_MAP,
+                                    GpuMemoryTracker::TextureBytes(GL_DEPTH_COMPONENT24, width_, height_));
 
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -51,24 +55,23 @@ class ShadowBuffer {
 
             // tie it all together
             {
-                glGenFramebuffers(1, &frame_buffer_object_);
-                glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer_object_);
+                glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer_object_.Create());
                 glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-                                     depth_texture_, 0);
+                                     depth_texture_.getId(), 0);
 
                 if (glCheckFramebufferStatus(GL_FRAMEBUFFER)
                     != GL_FRAMEBUFFER_COMPLETE)
                     std::cerr << "!!!ERROR: Framebuffer not OK :(" << std::endl;
 
                 glDrawBuffer(GL_NONE);
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                glBindFramebuffer(GL_FRAMEBUFFER, DEFAULT_FRAMEBUFFER);
             }
-            return depth_texture_;
+            return depth_texture_.getId();
         }
 
         void Cleanup() {
-            glBindFramebuffer(GL_FRAMEBUFFER, 0 /*UNBIND*/);
-            glDeleteFramebuffers(1, &frame_buffer_object_);
-            glDeleteTextures(1, &depth_texture_);
+            glBindFramebuffer(GL_FRAMEBUFFER, DEFAULT_FRAMEBUFFER /*UNBIND*/);
+            frame_buffer_object_.Reset();
+            depth_texture_.Reset();
         }
 };
@@ -4,6 +4,10 @@
 #include "icg_helper.h"
 #include "glm/gtc/type_ptr.hpp"
 #include "glm/gtc/matrix_transform.hpp"
+#include "../misc/profiling/cpu_profiler.h"
+#include "../misc/gl_state/gl_state.h"
+#include "../misc/shaders/shader_library.h"
+#include "../misc/gl_resource/gl_handle.h"
 
 static const unsigned int NbCubeVertices = 36;
 static const glm::vec3 CubeVertices[] =
@@ -96,35 +100,37 @@ static const glm::vec2 CubeUVs[] =
 class SkyBox {
 
     private:
-        GLuint vertex_array_id_;        // vertex array object
-        GLuint program_id_;             // GLSL shader program ID
-        GLuint vertex_buffer_object_;   // memory buffer
-        GLuint texture_id_;             // texture ID
-        GLuint texture_id_cube;             // texture ID
+        VertexArrayHandle vertex_array_id_;     // vertex array object
+        GLuint program_id_;                     // GLSL shader program ID
+        BufferHandle vertex_buffer_object_;     // memory buffer
+        BufferHandle texcoord_buffer_object_;   // memory buffer
+        TextureHandle texture_id_cube;          // texture ID
+        size_t cube_map_bytes_;                 // sum of the six faces
         glm::mat4 model_matrix_;        // model matrix
+        float scale_ = 100.0f;          // side of the cube
 
     public:
         void Init() {
             // compile the shaders.
-            program_id_ = icg_helper::LoadShaders("cube_vshader.glsl",
-                                                  "cube_fshader.glsl");
+            program_id_ = SHADER_LIBRARY.Get("cube_vshader.glsl",
+                                             "cube_fshader.glsl");
             if(!program_id_) {
                 exit(EXIT_FAILURE);
             }
 
-            glUseProgram(program_id_);
+            GL_STATE.UseProgram(program_id_);
 
             // vertex one vertex array
-            glGenVertexArrays(1, &vertex_array_id_);
-            glBindVertexArray(vertex_array_id_);
+            GL_STATE.BindVertexArray(vertex_array_id_.Create());
 
             // vertex coordinates
             {
                 // buffer
-                glGenBuffers(1, &vertex_buffer_object_);
-                glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
+                glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_.Create());
                 glBufferData(GL_ARRAY_BUFFER, NbCubeVertices * sizeof(glm::vec3),
                              &CubeVertices[0], GL_STATIC_DRAW);
+                GPU_MEMORY.Allocate(GPU_OBJECT_BUFFER, vertex_buffer_object_.getId(), GPU_MEMORY_GEOMETRY,
+                                    NbCubeVertices * sizeof(glm::vec3));
 
                 // attribute
                 GLuint vertex_point_id = glGetAttribLocation(program_id_, "vpoint");
@@ -136,10 +142,11 @@ class SkyBox {
             // texture coordinates
             {
                 // buffer
-                glGenBuffers(1, &vertex_buffer_object_);
-                glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
+                glBindBuffer(GL_ARRAY_BUFFER, texcoord_buffer_object_.Create());
                 glBufferData(GL_ARRAY_BUFFER, NbCubeUVs * sizeof(glm::vec2),
                              &CubeUVs[0], GL_STATIC_DRAW);
+                GPU_MEMORY.Allocate(GPU_OBJECT_BUFFER, texcoord_buffer_object_.getId(), GPU_MEMORY_GEOMETRY,
+                                    NbCubeUVs * sizeof(glm::vec2));
 
                 // attribute
                 GLuint vertex_texture_coord_id = glGetAttribLocation(program_id_,
@@ -150,8 +157,7 @@ class SkyBox {
             }
 
             {
-                glGenTextures (1, &texture_id_cube);
-                glBindTexture(GL_TEXTURE_CUBE_MAP, texture_id_cube);
+                GL_STATE.BindTexture(GL_TEXTURE_CUBE_MAP, texture_id_cube.Create());
 
                 // format cube map texture
                 glTexParameteri (GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -161,24 +167,28 @@ class SkyBox {
                 glTexParameteri (GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
                 // load each image and copy into a side of the cube-map texture
+                cube_map_bytes_ = 0;
                 assert (
-                        load_cube_map_side (texture_id_cube, GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, "front.tga"));
+                        load_cube_map_side (texture_id_cube.getId(), GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, "front.tga"));
                 assert (
-                        load_cube_map_side (texture_id_cube, GL_TEXTURE_CUBE_MAP_POSITIVE_Z, "back.tga"));
+                        load_cube_map_side (texture_id_cube.getId(), GL_TEXTURE_CUBE_MAP_POSITIVE_Z, "back.tga"));
                 assert (
-                        load_cube_map_side (texture_id_cube, GL_TEXTURE_CUBE_MAP_POSITIVE_Y, "top.tga"));
+                        load_cube_map_side (texture_id_cube.getId(), GL_TEXTURE_CUBE_MAP_POSITIVE_Y, "top.tga"));
                 assert (
-                        load_cube_map_side (texture_id_cube, GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, "bottom.tga"));
+                        load_cube_map_side (texture_id_cube.getId(), GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, "bottom.tga"));
                 assert (
-                        load_cube_map_side (texture_id_cube, GL_TEXTURE_CUBE_MAP_NEGATIVE_X, "right.tga"));
+                        load_cube_map_side (texture_id_cube.getId(), GL_TEXTURE_CUBE_MAP_NEGATIVE_X, "right.tga"));
                 assert (
-                        load_cube_map_side (texture_id_cube, GL_TEXTURE_CUBE_MAP_POSITIVE_X, "left.tga"));
+                        load_cube_map_side (texture_id_cube.getId(), GL_TEXTURE_CUBE_MAP_POSITIVE_X, "left.tga"));
+
+                GPU_MEMORY.Allocate(GPU_OBJECT_TEXTURE, texture_id_cube.getId(), GPU_MEMORY_MATERIALS,
+                                    cube_map_bytes_);
 
                 GLuint tex_id = glGetUniformLocation(program_id_, "tex_cube");
                 glUniform1i(tex_id, 1 /*GL_TEXTURE0*/);
 
                 // cleanup
-                glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+                GL_STATE.BindTexture(GL_TEXTURE_CUBE_MAP, 0);
             }
 
             // create the model matrix
@@ -188,6 +198,7 @@ class SkyBox {
         }
 
     bool load_cube_map_side (GLuint texture, GLenum side_target, const char* file_name) {
+        PROFILE_SCOPE("SkyBox::load_cube_map_side");
 
         int x, y, n;
         int force_channels = 4;
@@ -207,34 +218,37 @@ class SkyBox {
             glTexImage2D(side_target, 0, GL_RGBA, x, y, 0,
                          GL_RGBA, GL_UNSIGNED_BYTE, image);
         }
+        cube_map_bytes_ += GpuMemoryTracker::TextureBytes(GL_RGBA, x, y);
 
         free (image);
         return true;
     }
 
         void Cleanup() {
-            glBindVertexArray(0);
-            glUseProgram(0);
-            glDeleteBuffers(1, &vertex_buffer_object_);
-            glDeleteProgram(program_id_);
-            glDeleteVertexArrays(1, &vertex_array_id_);
-            glDeleteTextures(1, &texture_id_);
+            GL_STATE.BindVertexArray(0);
+            GL_STATE.UseProgram(0);
+            vertex_buffer_object_.Reset();
+            texcoord_buffer_object_.Reset();
+            SHADER_LIBRARY.Release(program_id_);
+            vertex_array_id_.Reset();
+            texture_id_cube.Reset();
+        }
+
+        /* The cube must contain the whole terrain and stay within the far plane. */
+        void setScale(float scale) {
+            scale_ = scale;
         }
 
         void Draw(const glm::mat4& view_projection){
-            glUseProgram(program_id_);
-            glBindVertexArray(vertex_array_id_);
+            GL_STATE.UseProgram(program_id_);
+            GL_STATE.BindVertexArray(vertex_array_id_.getId());
 
             // bind textures
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, texture_id_);
-
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, texture_id_cube);
+            GL_STATE.BindTexture(GL_TEXTURE1, GL_TEXTURE_CUBE_MAP, texture_id_cube.getId());
 
 
             // setup MVP
-            glm::mat4 model = scale(model_matrix_, glm::vec3(100.0f));
+            glm::mat4 model = scale(model_matrix_, glm::vec3(scale_));
 
             glm::mat4 MVP = view_projection * model;
             GLuint MVP_id = glGetUniformLocation(program_id_, "MVP");
@@ -243,10 +257,9 @@ class SkyBox {
             GLuint M_id = glGetUniformLocation(program_id_, "M");
             glUniformMatrix4fv(M_id, 1, GL_FALSE, value_ptr(model));
 
+            GL_STATE.Disable(GL_BLEND);
+
             // draw
             glDrawArrays(GL_TRIANGLES,0, NbCubeVertices);
-
-            glBindVertexArray(0);
-            glUseProgram(0);
         }
 };
@@ -8,14 +8,17 @@
 #include "../../../external/glm/detail/type_mat.hpp"
 #include "../../../external/glm/gtc/matrix_transform.hpp"
 #include "../../config.h"
+#include "../../misc/profiling/cpu_profiler.h"
+#include "../../misc/gl_state/gl_state.h"
+#include "../../misc/profiling/gpu_memory.h"
+#include "../../misc/shaders/shader_library.h"
+#include "../../render_queue/render_queue.h"
+#include "heightfield.h"
 
-#define CHUNK_SIDE_TILE_COUNT 4
 #define INTRO_MIN_HEIGHT 20.f
 #define INTRO_DURATION 9.0f
 #define INTRO_THRESHOLD 0.0001
 
-#define TERRAIN_CHUNK_SIZE 10 // TODO
-
 
 class Grass {
 
@@ -34,6 +37,7 @@ private :
     float m_maxXpos;
     float m_minZpos;
     float m_maxZpos;
+    glm::vec2 m_fog_range;
 
 
 public :
@@ -48,18 +52,13 @@ public :
     }
 
     void Init() {
-        if (grass_program_id == 0) {
-            program_id_ = icg_helper::LoadShaders("grass_vshader.glsl", "grass_fshader.glsl", "grass_gshader.glsl");
-            grass_program_id = program_id_;
-        } else {
-            program_id_ = grass_program_id;
-        }
+        program_id_ = SHADER_LIBRARY.Get("grass_vshader.glsl", "grass_fshader.glsl", "grass_gshader.glsl");
 
-        glUseProgram(program_id_);
+        GL_STATE.UseProgram(program_id_);
 
         // vertex one vertex Array
         glGenVertexArrays(1, &vertex_array_id_);
-        glBindVertexArray(vertex_array_id_);
+        GL_STATE.BindVertexArray(vertex_array_id_);
 
         // vertex coordinates
         {
@@ -99,6 +98,8 @@ public :
             glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
             glBufferData(GL_ARRAY_BUFFER, vertex_point.size() * sizeof(GL_FLOAT),
                          vertex_point.data(), GL_STATIC_DRAW);
+            GPU_MEMORY.Allocate(GPU_OBJECT_BUFFER, vertex_buffer_object_, GPU_MEMORY_GRASS,
+                                vertex_point.size() * sizeof(GL_FLOAT));
 
             // attribute
             GLuint vertex_point_id = glGetAttribLocation(program_id_, "vpoint");
@@ -112,20 +113,40 @@ public :
         glUniform1i(glGetUniformLocation(program_id_, "gSampler"), 0 /*GL_TEXTURE*/);
         glUniform1i(glGetUniformLocation(program_id_, "perlin_tex"), 1 /*GL_TEXTURE0*/);
 
-        glBindVertexArray(0);
-        glUseProgram(0);
+        GL_STATE.BindVertexArray(0);
+        GL_STATE.UseProgram(0);
+    }
+
+    void Cleanup() {
+        GL_STATE.BindVertexArray(0);
+        GL_STATE.UseProgram(0);
+        GPU_MEMORY.Free(GPU_OBJECT_BUFFER, vertex_buffer_object_);
+        glDeleteBuffers(1, &vertex_buffer_object_);
+        GL_STATE.DeleteVertexArrays(1, &vertex_array_id_);
+        GPU_MEMORY.Free(GPU_OBJECT_TEXTURE, m_texture_id);
+        GL_STATE.DeleteTextures(1, &m_texture_id);
+        SHADER_LIBRARY.Release(program_id_);
+    }
+
+    /* For the render queue's sort key. */
+    GLuint getProgramId() {
+        return program_id_;
     }
 
     void setPerlinTextureId(GLuint textureId) {
         m_texture_perlin_id = textureId;
     }
 
+    void setFogRange(glm::vec2 range) {
+        m_fog_range = range;
+    }
+
     void Draw(float amplitude, float time, const glm::mat4 &model = IDENTITY_MATRIX,
               const glm::mat4 &view = IDENTITY_MATRIX,
               const glm::mat4 &projection = IDENTITY_MATRIX) {
 
-        glUseProgram(program_id_);
-        glBindVertexArray(vertex_array_id_);
+        GL_STATE.UseProgram(program_id_);
+        GL_STATE.BindVertexArray(vertex_array_id_);
         glUniformMatrix4fv(glGetUniformLocation(program_id_, "model"), ONE, DONT_TRANSPOSE, glm::value_ptr(model));
         glUniformMatrix4fv(glGetUniformLocation(program_id_, "view"), ONE, DONT_TRANSPOSE, glm::value_ptr(view));
         glUniformMatrix4fv(glGetUniformLocation(program_id_, "projection"), ONE, DONT_TRANSPOSE,
@@ -133,29 +154,25 @@ public :
 
         glUniform1f(glGetUniformLocation(program_id_, "time"), time);
         glUniform1f(glGetUniformLocation(program_id_, "amplitude"), amplitude);
+        glUniform2fv(glGetUniformLocation(program_id_, "fog_range"), ONE, glm::value_ptr(m_fog_range));
 
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_texture_id);
+        GL_STATE.BindTexture(GL_TEXTURE0, GL_TEXTURE_2D, m_texture_id);
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, m_texture_perlin_id);
+        GL_STATE.BindTexture(GL_TEXTURE1, GL_TEXTURE_2D, m_texture_perlin_id);
 
 
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        GL_STATE.Enable(GL_BLEND);
+        GL_STATE.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         // draw
         //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
         glDrawArrays(GL_POINTS, 0, m_grass_triangles_count);
-        glDisable(GL_BLEND);
-
-        glBindVertexArray(0);
-        glUseProgram(0);
     }
 
 
     GLuint loadDDS(const char *imagepath) {
+        PROFILE_SCOPE("Grass::loadDDS");
         unsigned char header[124];
 
         FILE *fp;
@@ -201,17 +218,19 @@ public :
         glGenTextures(1, &textureID);
 
         // "Bind" the newly created texture : all future texture functions will modify this texture
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GL_STATE.BindTexture(GL_TEXTURE_2D, textureID);
         glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
         unsigned int blockSize = 8;
         unsigned int offset = 0;
+        size_t bytes = 0;
 
         /* load the mipmaps */
         for (unsigned int level = 0; level < 1 && (width || height); ++level) {
             unsigned int size = ((width + 3) / 4) * ((height + 3) / 4) * blockSize;
             glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height,
                                    0, size, buffer + offset);
+            bytes += size;
 
             offset += size;
             width = width / 2 > 1 ? width / 2 : 1;
@@ -221,11 +240,12 @@ public :
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         //glGenerateMipmap(GL_TEXTURE_2D);
+        GPU_MEMORY.Allocate(GPU_OBJECT_TEXTURE, textureID, GPU_MEMORY_GRASS, bytes);
 
         free(buffer);
 
         //Unbind the texture
-        glBindTexture(GL_TEXTURE_2D, 0);
+        GL_STATE.BindTexture(GL_TEXTURE_2D, 0);
 
 
         return textureID;
@@ -234,33 +254,63 @@ public :
 
 Grass *BASE_GRASS;
 
-class Chunk : public Observer {
+/* What a chunk generates, handed over between Chunk and ChunkCache. */
+struct CachedChunk {
+    FrameBuffer *heightmap = NULL;
+    Heightfield heightfield;
+};
+
+class Chunk {
 public:
     Chunk(glm::vec2 pos, uint32_t quad_res, PerlinNoise *perlinNoise) {
         m_position = pos;
         m_perlin_noise = perlinNoise;
+        m_heightmap = NULL;
+        m_chunk_noise_tex_id = 0;
     }
 
+    /* Empty slot, see ChunkGrid. Place() it before Init(). */
+    Chunk() : Chunk(glm::vec2(0, 0), 0, NULL) { }
+
     ~Chunk() { }
 
-    void Init() {
-        m_perlin_noise->attach(this);
-        m_chunk_noise_tex_id = m_perlin_noise->generateNoise(glm::vec2(m_position.x, m_position.y));
+    /* With cached, the chunk takes over data generated earlier for the same position instead
+     * of generating it again. */
+    void Init(CachedChunk *cached = NULL) {
+        /* Init() can be called several times, the bus ignores the duplicates. */
+        Subscription subscription = EVENT_BUS.Subscribe<PerlinNoisePropChangedEvent>(
+                [this](const PerlinNoisePropChangedEvent &e) {
+                    onPerlinPropChanged(e);
+                }, this);
+        if (subscription.isActive())
+            m_noise_subscription = std::move(subscription);
+        if (cached && cached->heightmap) {
+            m_perlin_noise->releaseHeightmap(m_heightmap);
+            m_heightmap = cached->heightmap;
+            cached->heightmap = NULL;
+            m_chunk_noise_tex_id = m_heightmap->getTextureId();
+            std::swap(m_heightfield, cached->heightfield);
+            return;
+        }
+        /* Heightmaps of destroyed chunks are recycled by the pool. */
+        if (!m_heightmap)
+            m_heightmap = m_perlin_noise->acquireHeightmap();
+        _generate();
     }
 
-    void Draw(float amplitude, float time, float water_height, GLuint left_tex, GLuint low_tex, GLuint low_left_tex,
-              const glm::mat4 &model = IDENTITY_MATRIX,
-              const glm::mat4 &view = IDENTITY_MATRIX,
-              const glm::mat4 &projection = IDENTITY_MATRIX) {
-        glm::vec2 middle_coord = glm::vec2(TERRAIN_CHUNK_SIZE * CHUNK_SIDE_TILE_COUNT / 2.f);
+    /* Queues one packet per tile and one for the grass, model is the chunk's model matrix
+     * and terrain_size the number of chunks per side of the terrain. */
+    void Submit(RenderQueue &queue, float time, int terrain_size, const glm::mat4 &model, const glm::mat4 &view) {
+        glm::vec2 middle_coord = glm::vec2(terrain_size * CHUNK_SIDE_TILE_COUNT / 2.f);
         double alpha = -log(INTRO_THRESHOLD / ((middle_coord.length()) * INTRO_MIN_HEIGHT)) /
                        INTRO_DURATION; // no need to compute every time.
+        DrawPacket packet;
+        packet.draw = &Chunk::_drawTile;
+        packet.object = this;
+        packet.textures[0] = m_chunk_noise_tex_id;
+        packet.textures[1] = getNormalTextureId();
         for (int i = 0; i < CHUNK_SIDE_TILE_COUNT; i++) {
             for (int j = 0; j < CHUNK_SIDE_TILE_COUNT; j++) {
-                BASE_TILE->setTextureId(m_chunk_noise_tex_id);
-                BASE_TILE->setTextureLeft(left_tex);
-                BASE_TILE->setTextureLow(low_tex);
-                BASE_TILE->setTextureLowLeft(low_left_tex);
                 float height = 0;
                 if (time < INTRO_DURATION) {
                     glm::vec2 global_tile_pos = glm::vec2(i + m_position.x * CHUNK_SIDE_TILE_COUNT,
@@ -268,29 +318,48 @@ public:
                     float dist_middle = 2.0f * distance(middle_coord, global_tile_pos);
                     height = (dist_middle) * INTRO_MIN_HEIGHT * exp(-alpha * time);
                 }
-                glm::mat4 _model = glm::translate(model, glm::vec3(i, height, j));
-                BASE_TILE->Draw(m_position - TERRAIN_OFFSET, glm::vec2(i, j), amplitude, water_height, time, _model,
-                                view, projection);
+                packet.model = glm::translate(model, glm::vec3(i, height, j));
+                packet.params = glm::vec4(m_position - TERRAIN_OFFSET, (float) i, (float) j);
+                float depth = RenderQueue::ViewDepth(view, packet.model, glm::vec3(0.5f, 0.f, 0.5f));
+                GLuint program = BASE_TILE->getDrawPID(m_position - TERRAIN_OFFSET);
+                packet.key = RenderQueue::OpaqueKey(RENDER_PASS_TERRAIN, program, m_chunk_noise_tex_id, depth);
+                queue.Submit(packet);
             }
         }
 
         if (time >= INTRO_DURATION) {
-            BASE_GRASS->setPerlinTextureId(m_chunk_noise_tex_id);
-            BASE_GRASS->Draw(amplitude, time, model, view, projection);
+            /* Grass blends, so it goes back to front. */
+            packet.draw = &Chunk::_drawGrass;
+            packet.model = model;
+            float depth = RenderQueue::ViewDepth(view, model, glm::vec3(CHUNK_SIDE_TILE_COUNT / 2.f, 0.f,
+                                                                        CHUNK_SIDE_TILE_COUNT / 2.f));
+            packet.key = RenderQueue::TransparentKey(RENDER_PASS_GRASS, BASE_GRASS->getProgramId(), m_chunk_noise_tex_id,
+                                                     depth);
+            queue.Submit(packet);
         }
     }
 
-    void Cleanup() {
+    /* With cached, the heightmap and the heights are moved there instead of being released. */
+    void Cleanup(CachedChunk *cached = NULL) {
+        m_noise_subscription.Reset();
+        if (cached) {
+            cached->heightmap = m_heightmap;
+            std::swap(m_heightfield, cached->heightfield);
+        } else {
+            m_perlin_noise->releaseHeightmap(m_heightmap);
+        }
+        m_heightmap = NULL;
+        m_chunk_noise_tex_id = 0;
+    }
 
+    void onPerlinPropChanged(const PerlinNoisePropChangedEvent &) {
+        _generate();
     }
 
-    virtual void update(Message *msg) {
-        if (msg->getType() == Message::Type::PERLIN_PROP_CHANGE) {
-            m_chunk_noise_tex_id = m_perlin_noise->generateNoise(m_position);
-        }
-        else {
-            throw std::string("Error unexpected message type.");
-        }
+    /* Moves a chunk that is not initialised, or has been cleaned up, to other indices. */
+    void Place(glm::vec2 pos, PerlinNoise *perlinNoise) {
+        m_position = pos;
+        m_perlin_noise = perlinNoise;
     }
 
     glm::vec2 getPosition() {
@@ -301,9 +370,49 @@ public:
         return m_chunk_noise_tex_id;
     }
 
+    int getNormalTextureId() {
+        return m_heightmap ? m_heightmap->getSecondaryTextureId() : 0;
+    }
+
+    FrameBuffer *getHeightmap() {
+        return m_heightmap;
+    }
+
+    /* CPU copy of the heights, regenerated with the heightmap. */
+    Heightfield &getHeightfield() {
+        return m_heightfield;
+    }
+
 private:
     glm::vec2 m_position;
     PerlinNoise *m_perlin_noise;
+    /* Owned while the chunk lives, returned to FRAMEBUFFER_POOL by Cleanup(). */
+    FrameBuffer *m_heightmap;
     int m_chunk_noise_tex_id;
+    Heightfield m_heightfield;
+    /* Detaches itself from the bus when the chunk is deleted. */
+    Subscription m_noise_subscription;
+
+    void _generate() {
+        m_chunk_noise_tex_id = m_perlin_noise->generateNoise(m_heightmap, m_position);
+        std::vector<float> heights;
+        m_perlin_noise->generateHeights(m_position, heights);
+        m_heightfield.Build(heights, HEIGHTFIELD_RESOLUTION);
+    }
+
+    static void _drawTile(const DrawPacket &packet, const RenderContext &context) {
+        BASE_TILE->setTextureId(packet.textures[0]);
+        BASE_TILE->setNormalTextureId(packet.textures[1]);
+        BASE_TILE->setFogRange(context.fog_range);
+        BASE_TILE->Draw(glm::vec2(packet.params.x, packet.params.y), glm::vec2(packet.params.z, packet.params.w),
+                        context.amplitude, context.water_height, context.time, packet.model, context.view,
+                        context.projection);
+    }
+
+    static void _drawGrass(const DrawPacket &packet, const RenderContext &context) {
+        BASE_GRASS->setPerlinTextureId(packet.textures[0]);
+        BASE_GRASS->setFogRange(context.fog_range);
+        BASE_GRASS->Draw(context.amplitude, context.time, packet.model, context.view, context.projection);
+    }
 };
 
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <iostream>
+#include "../../../external/glm/glm.hpp"
+#include "../../misc/event_bus/event_bus.h"
+#include "chunk.h"
+
+/* Chunks that recently left the terrain, kept with their heightmap and heights so
+ * that coming back to them is not a new generation. The least recently dropped
+ * chunk goes first once the capacity is reached, and everything goes when the
+ * noise changes since the data would be stale. Evicted heightmaps return to
+ * FRAMEBUFFER_POOL. */
+class ChunkCache {
+public:
+    explicit ChunkCache(PerlinNoise *perlin_noise) {
+        m_perlin_noise = perlin_noise;
+        m_capacity = 0;
+        m_hits = 0;
+        m_misses = 0;
+    }
+
+    void Init() {
+        m_noise_subscription = EVENT_BUS.Subscribe<PerlinNoisePropChangedEvent>(
+                [this](const PerlinNoisePropChangedEvent &) {
+                    Clear();
+                }, this);
+    }
+
+    /* In chunks, 0 disables the cache. */
+    void setCapacity(size_t capacity) {
+        m_capacity = capacity;
+        while (m_entries.size() > m_capacity)
+            EvictOne();
+    }
+
+    /* Moves the chunk at indices out of the cache into chunk, false when it is not there. */
+    bool Take(glm::ivec2 indices, CachedChunk &chunk) {
+        std::map<std::pair<int, int>, std::list<Entry>::iterator>::iterator it = m_index.find(_key(indices));
+        if (it == m_index.end()) {
+            m_misses++;
+            return false;
+        }
+        m_perlin_noise->releaseHeightmap(chunk.heightmap);
+        chunk.heightmap = it->second->chunk.heightmap;
+        std::swap(chunk.heightfield, it->second->chunk.heightfield);
+        m_entries.erase(it->second);
+        m_index.erase(it);
+        m_hits++;
+        return true;
+    }
+
+    /* Keeps what chunk holds for the chunk at indices, the cache owns the heightmap from now on. */
+    void Put(glm::ivec2 indices, CachedChunk &chunk) {
+        if (!chunk.heightmap)
+            return;
+        if (m_capacity == 0) {
+            m_perlin_noise->releaseHeightmap(chunk.heightmap);
+            chunk.heightmap = NULL;
+            return;
+        }
+        std::map<std::pair<int, int>, std::list<Entry>::iterator>::iterator it = m_index.find(_key(indices));
+        if (it != m_index.end())
+            _erase(it);
+        m_entries.push_front(Entry());
+        m_entries.front().indices = indices;
+        m_entries.front().chunk.heightmap = chunk.heightmap;
+        std::swap(m_entries.front().chunk.heightfield, chunk.heightfield);
+        chunk.heightmap = NULL;
+        m_index[_key(indices)] = m_entries.begin();
+        while (m_entries.size() > m_capacity)
+            EvictOne();
+    }
+
+    /* Drops the least recently stored chunk, false when the cache is empty. */
+    bool EvictOne() {
+        if (m_entries.empty())
+            return false;
+        _erase(m_index.find(_key(m_entries.back().indices)));
+        return true;
+    }
+
+    void Clear() {
+        while (EvictOne()) {}
+    }
+
+    size_t getSize() {
+        return m_entries.size();
+    }
+
+    void Report(std::ostream &out) {
+        out << "Chunk cache : " << m_entries.size() << " chunks, " << m_hits << " hits, " << m_misses
+            << " misses" << std::endl;
+    }
+
+    void Cleanup() {
+        Clear();
+        m_noise_subscription.Reset();
+    }
+
+private:
+    struct Entry {
+        glm::ivec2 indices;
+        CachedChunk chunk;
+    };
+
+    PerlinNoise *m_perlin_noise;
+    size_t m_capacity;
+    /* Most recently stored first. */
+    std::list<Entry> m_entries;
+    std::map<std::pair<int, int>, std::list<Entry>::iterator> m_index;
+    unsigned long m_hits;
+    unsigned long m_misses;
+    Subscription m_noise_subscription;
+
+    static std::pair<int, int> _key(glm::ivec2 indices) {
+        return std::make_pair(indices.x, indices.y);
+    }
+
+    void _erase(std::map<std::pair<int, int>, std::list<Entry>::iterator>::iterator it) {
+        m_perlin_noise->releaseHeightmap(it->second->chunk.heightmap);
+        m_entries.erase(it->second);
+        m_index.erase(it);
+    }
+};
@@ -13,8 +13,9 @@ public:
 
     }
 
-    Chunk *createChunk(glm::vec2 indices){
-        return new Chunk( indices, m_tile_side_size, m_perlin_noise);
+    /* The chunks live in the slots of a ChunkGrid, the factory only sets them up. */
+    void placeChunk(Chunk &chunk, glm::vec2 indices){
+        chunk.Place(indices, m_perlin_noise);
     }
 
 private:
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include "../../../external/glm/glm.hpp"
+#include "chunk.h"
+
+/* Fixed number of chunk slots, laid out in one array and addressed by the global
+ * indices of the chunk modulo the capacity. Any square window of at most
+ * capacity chunks per side maps to distinct slots, so moving the terrain by a row
+ * only frees the slots of the row that leaves and takes those of the row that
+ * enters : nothing is reallocated and the other chunks stay where they are.
+ * The grid only stores the chunks, Init() and Cleanup() are up to the caller. */
+class ChunkGrid {
+public:
+    explicit ChunkGrid(int capacity)
+            : m_capacity(capacity), m_slots(capacity * capacity) {
+    }
+
+    int getCapacity() {
+        return m_capacity;
+    }
+
+    /* NULL when the chunk at these indices is not in the grid. */
+    Chunk *Get(glm::ivec2 indices) {
+        Slot &slot = _slot(indices);
+        return slot.used && slot.indices == indices ? &slot.chunk : NULL;
+    }
+
+    /* Slot for the chunk at these indices, which the caller then places and initialises.
+     * The slot must be free : the window of chunks cannot exceed the capacity. */
+    Chunk *Take(glm::ivec2 indices) {
+        Slot &slot = _slot(indices);
+        slot.used = true;
+        slot.indices = indices;
+        return &slot.chunk;
+    }
+
+    /* The chunk must have been cleaned up. Its slot keeps the CPU buffers for the next one. */
+    void Free(glm::ivec2 indices) {
+        Slot &slot = _slot(indices);
+        if (slot.indices == indices)
+            slot.used = false;
+    }
+
+private:
+    struct Slot {
+        Chunk chunk;
+        glm::ivec2 indices;
+        bool used = false;
+    };
+
+    int m_capacity;
+    /* x major, like the loops of Terrain. Never resized : the chunks' event handlers point into it. */
+    std::vector<Slot> m_slots;
+
+    static int _wrap(int value, int capacity) {
+        int wrapped = value % capacity;
+        return wrapped < 0 ? wrapped + capacity : wrapped;
+    }
+
+    Slot &_slot(glm::ivec2 indices) {
+        return m_slots[_wrap(indices.x, m_capacity) * m_capacity + _wrap(indices.y, m_capacity)];
+    }
+};
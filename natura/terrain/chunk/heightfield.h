@@ -0,0 +1,192 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "../../../external/glm/glm.hpp"
+
+/* CPU copy of the heights of a chunk, for the queries that used to read the
+ * heightmap back from the GPU. The samples cover the chunk on a regular grid,
+ * in chunk units : x and z in [0, 1], y the raw noise value.
+ * A pyramid of min/max heights over the cells lets Raycast() skip the empty
+ * space by whole blocks before testing single cells. */
+class Heightfield {
+public:
+    /* samples holds resolution^2 values, row by row along x. */
+    void Build(const std::vector<float> &samples, int resolution) {
+        m_resolution = resolution;
+        m_samples = samples;
+        m_levels.clear();
+        if (m_resolution < 2)
+            return;
+
+        /* Level 0 has one entry per cell, each next level halves the side. */
+        int side = m_resolution - 1;
+        std::vector<glm::vec2> level(side * side);
+        for (int z = 0; z < side; z++) {
+            for (int x = 0; x < side; x++) {
+                float h00 = _at(x, z), h10 = _at(x + 1, z), h01 = _at(x, z + 1), h11 = _at(x + 1, z + 1);
+                level[z * side + x] = glm::vec2(std::min(std::min(h00, h10), std::min(h01, h11)),
+                                                std::max(std::max(h00, h10), std::max(h01, h11)));
+            }
+        }
+        m_levels.push_back(level);
+        m_sides.assign(1, side);
+        while (side > 1) {
+            int next_side = (side + 1) / 2;
+            std::vector<glm::vec2> next(next_side * next_side, glm::vec2(INFINITY, -INFINITY));
+            for (int z = 0; z < side; z++) {
+                for (int x = 0; x < side; x++) {
+                    glm::vec2 &range = next[(z / 2) * next_side + x / 2];
+                    range.x = std::min(range.x, m_levels.back()[z * side + x].x);
+                    range.y = std::max(range.y, m_levels.back()[z * side + x].y);
+                }
+            }
+            m_levels.push_back(next);
+            m_sides.push_back(next_side);
+            side = next_side;
+        }
+    }
+
+    bool isValid() {
+        return !m_levels.empty();
+    }
+
+    /* Bilinear height at pos in [0, 1]^2, the same surface Raycast() intersects. */
+    float Sample(glm::vec2 pos) {
+        int x, z;
+        glm::vec2 f = _cell(pos, x, z);
+        float h00 = _at(x, z), h10 = _at(x + 1, z), h01 = _at(x, z + 1), h11 = _at(x + 1, z + 1);
+        return glm::mix(glm::mix(h00, h10, f.x), glm::mix(h01, h11, f.x), f.y);
+    }
+
+    /* Derivatives of Sample() along x and z, per chunk unit. */
+    glm::vec2 Gradient(glm::vec2 pos) {
+        int x, z;
+        glm::vec2 f = _cell(pos, x, z);
+        float h00 = _at(x, z), h10 = _at(x + 1, z), h01 = _at(x, z + 1), h11 = _at(x + 1, z + 1);
+        float cells = (float) (m_resolution - 1);
+        return cells * glm::vec2(glm::mix(h10 - h00, h11 - h01, f.y), glm::mix(h01 - h00, h11 - h10, f.x));
+    }
+
+    /* Lowest and highest sample of the chunk. */
+    glm::vec2 getRange() {
+        return m_levels.empty() ? glm::vec2(0.f) : m_levels.back()[0];
+    }
+
+    /* First t in [t_min, t_max] where origin + t * dir reaches the surface, in chunk units.
+     * A ray starting under the surface hits where it enters the chunk. */
+    bool Raycast(glm::vec3 origin, glm::vec3 dir, float t_min, float t_max, float &t_hit) {
+        if (m_levels.empty())
+            return false;
+        struct Node {
+            int level, x, z;
+        };
+        /* Children are pushed far to near so that the nearest one is visited first,
+         * the first leaf hit is then the closest. */
+        int first_x = dir.x >= 0.f ? 0 : 1;
+        int first_z = dir.z >= 0.f ? 0 : 1;
+        Node stack[64];
+        int count = 0;
+        stack[count++] = {(int) m_levels.size() - 1, 0, 0};
+        while (count > 0) {
+            Node node = stack[--count];
+            float cell = (float) (1 << node.level) / (m_resolution - 1);
+            glm::vec2 range = m_levels[node.level][node.z * m_sides[node.level] + node.x];
+            float t0 = t_min, t1 = t_max;
+            if (!_clip(origin, dir, glm::vec3(node.x * cell, range.x, node.z * cell),
+                       glm::vec3((node.x + 1) * cell, range.y, (node.z + 1) * cell), t0, t1))
+                continue;
+            if (node.level == 0) {
+                if (_intersectCell(origin, dir, node.x, node.z, t0, t1, t_hit))
+                    return true;
+                continue;
+            }
+            int side = m_sides[node.level - 1];
+            for (int i = 3; i >= 0; i--) {
+                int x = 2 * node.x + ((i & 1) ^ first_x);
+                int z = 2 * node.z + ((i >> 1) ^ first_z);
+                if (x < side && z < side)
+                    stack[count++] = {node.level - 1, x, z};
+            }
+        }
+        return false;
+    }
+
+private:
+    int m_resolution = 0;
+    std::vector<float> m_samples;
+    /* m_levels[k] is the min/max of blocks of 2^k cells per side, m_sides[k] blocks per side. */
+    std::vector<std::vector<glm::vec2> > m_levels;
+    std::vector<int> m_sides;
+
+    float _at(int x, int z) {
+        return m_samples[z * m_resolution + x];
+    }
+
+    /* Cell containing pos, returns the position inside it. */
+    glm::vec2 _cell(glm::vec2 pos, int &x, int &z) {
+        glm::vec2 p = glm::clamp(pos, 0.f, 1.f) * (float) (m_resolution - 1);
+        x = std::min((int) p.x, m_resolution - 2);
+        z = std::min((int) p.y, m_resolution - 2);
+        return p - glm::vec2(x, z);
+    }
+
+    /* Slab test, narrows [t0, t1] to the part of the ray inside the box. */
+    static bool _clip(glm::vec3 origin, glm::vec3 dir, glm::vec3 box_min, glm::vec3 box_max, float &t0, float &t1) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (std::abs(dir[axis]) < 1e-12f) {
+                if (origin[axis] < box_min[axis] || origin[axis] > box_max[axis])
+                    return false;
+                continue;
+            }
+            float t_near = (box_min[axis] - origin[axis]) / dir[axis];
+            float t_far = (box_max[axis] - origin[axis]) / dir[axis];
+            if (t_near > t_far)
+                std::swap(t_near, t_far);
+            t0 = std::max(t0, t_near);
+            t1 = std::min(t1, t_far);
+            if (t0 > t1)
+                return false;
+        }
+        return true;
+    }
+
+    /* Along the ray the bilinear patch is quadratic in t, so the hit is solved exactly. */
+    bool _intersectCell(glm::vec3 origin, glm::vec3 dir, int x, int z, float t0, float t1, float &t_hit) {
+        float cells = (float) (m_resolution - 1);
+        float h00 = _at(x, z), h10 = _at(x + 1, z), h01 = _at(x, z + 1), h11 = _at(x + 1, z + 1);
+        float b = h10 - h00, c = h01 - h00, d = h00 - h10 - h01 + h11;
+        float pu = origin.x * cells - x, qu = dir.x * cells;
+        float pv = origin.z * cells - z, qv = dir.z * cells;
+        /* f(t) = ray height - surface height = k0 + k1 * t + k2 * t^2 */
+        float k0 = origin.y - (h00 + b * pu + c * pv + d * pu * pv);
+        float k1 = dir.y - (b * qu + c * qv + d * (pu * qv + qu * pv));
+        float k2 = -d * qu * qv;
+
+        if (k0 + (k1 + k2 * t0) * t0 <= 0.f) {
+            t_hit = t0;
+            return true;
+        }
+        float roots[2];
+        int root_count = 0;
+        if (std::abs(k2) < 1e-9f) {
+            if (std::abs(k1) > 1e-12f)
+                roots[root_count++] = -k0 / k1;
+        } else {
+            float disc = k1 * k1 - 4.f * k2 * k0;
+            if (disc < 0.f)
+                return false;
+            float sq = std::sqrt(disc);
+            roots[root_count++] = std::min((-k1 - sq) / (2.f * k2), (-k1 + sq) / (2.f * k2));
+            roots[root_count++] = std::max((-k1 - sq) / (2.f * k2), (-k1 + sq) / (2.f * k2));
+        }
+        for (int i = 0; i < root_count; i++) {
+            if (roots[i] >= t0 && roots[i] <= t1) {
+                t_hit = roots[i];
+                return true;
+            }
+        }
+        return false;
+    }
+};
@@ -1,104 +1,242 @@
 #pragma once
 
 #include <cstdint>
-#include <deque>
+#include <cmath>
 #include "../grid/grid.h"
 #include "chunk/chunk.h"
+#include "chunk/chunk_grid.h"
+#include "chunk/chunk_cache.h"
 #include "chunk/chunk_generation/chunk_factory.h"
 #include "../water_grid/water_grid.h"
 #include "../skybox/skybox.h"
 #include "../config.h"
+#include "../render_queue/render_queue.h"
+#include "../misc/profiling/cpu_profiler.h"
+
+/* Result of Terrain::Raycast(). */
+struct TerrainHit {
+    glm::vec3 position;
+    glm::vec3 normal;
+    /* Along the normalized ray direction. */
+    float distance;
+    Chunk *chunk;
+};
 
 class Terrain {
 public:
+    /* chunk_per_side goes through ClampChunkCount(). */
     Terrain(  uint32_t chunk_per_side, uint32_t quad_side_size, PerlinNoise *perlinNoise)
-            : m_chunk_factory( quad_side_size, perlinNoise) {
-        for (int i = 0; i < chunk_per_side; i++) {
-            std::deque<Chunk *> row;
-            for (int j = 0; j < chunk_per_side; j++) {
-                row.push_back(m_chunk_factory.createChunk(glm::vec2(i, j)));
-            }
-            m_chunks.push_back(row);
-        }
+            : m_chunk_factory( quad_side_size, perlinNoise), m_chunks(TERRAIN_CHUNK_SIZE_MAX),
+              m_chunk_cache(perlinNoise) {
+        m_perlin_noise = perlinNoise;
+        m_chunk_count = ClampChunkCount(chunk_per_side);
         m_skybox = new SkyBox();
+        m_amplitude = 0.f;
+        m_lean = glm::ivec2(0);
+        m_lean_chunk = glm::ivec2(0);
         TERRAIN_OFFSET = glm::vec2(0, 0);
-        m_perlin_noise = perlinNoise;
     }
 
     void Init(GLuint water_reflection_tex) {
         m_water_grid.Init(water_reflection_tex);
         m_skybox->Init();
-        for (size_t i = 0; i < m_chunks.size(); i++) {
-            for (size_t j = 0; j < m_chunks[i].size(); j++) {
-                m_chunks[i][j]->Init();
+        m_chunk_cache.Init();
+        _applyChunkCount();
+        glm::ivec2 offset = glm::ivec2(TERRAIN_OFFSET);
+        for (int i = 0; i < m_chunk_count; i++) {
+            for (int j = 0; j < m_chunk_count; j++) {
+                _createChunk(offset + glm::ivec2(i, j));
             }
         }
     }
 
-    void Draw(float amplitude, float time, glm::vec3 cam_pos, bool onlyTerrain, bool draw_skybox,
-              const glm::mat4 &model = IDENTITY_MATRIX,
-              const glm::mat4 &view = IDENTITY_MATRIX,
-              const glm::mat4 &projection = IDENTITY_MATRIX) {
+    /* Queues the skybox, the tiles, the grass and, unless onlyTerrain, the water. */
+    void Submit(RenderQueue &queue, float amplitude, float time, glm::vec3 cam_pos, bool onlyTerrain,
+                const glm::mat4 &model = IDENTITY_MATRIX,
+                const glm::mat4 &view = IDENTITY_MATRIX) {
+        PROFILE_SCOPE("Terrain::Submit");
 
         m_amplitude = amplitude;
 
-        m_skybox->Draw(projection * view * glm::translate(model, -cam_pos / TERRAIN_SCALE));
+        DrawPacket packet;
+        packet.draw = &Terrain::_drawSkybox;
+        packet.object = m_skybox;
+        packet.model = glm::translate(model, -cam_pos / TERRAIN_SCALE);
+        packet.key = RenderQueue::OpaqueKey(RENDER_PASS_SKY, 0, 0, 0.f);
+        queue.Submit(packet);
+
         glm::mat4 _m = glm::translate(model, glm::vec3(TERRAIN_OFFSET.x * CHUNK_SIDE_TILE_COUNT, 0,
                                                        TERRAIN_OFFSET.y * CHUNK_SIDE_TILE_COUNT));
-        for (size_t i = 0; i < m_chunks.size(); i++) {
-            for (size_t j = 0; j < m_chunks[i].size(); j++) {
-                GLuint left = j < m_chunks[i].size() - 1 ? m_chunks[i][j + 1]->getTextureId() : 0;
-                GLuint low = i < m_chunks.size() - 1 ? m_chunks[i + 1][j]->getTextureId() : 0;
-                GLuint low_left =
-                        i < m_chunks.size() - 1 && j < m_chunks[i].size() - 1 ? m_chunks[i + 1][j + 1]->getTextureId()
-                                                                              : 0;
-                m_chunks[i][j]->Draw(amplitude, time, m_water_height * CHUNK_SIDE_TILE_COUNT, left, low, low_left,
-                                     glm::translate(_m, glm::vec3(i * CHUNK_SIDE_TILE_COUNT,
-                                                                  0.0, j *
-                                                                       CHUNK_SIDE_TILE_COUNT)),
-                                     view, projection);
+        for (int i = 0; i < m_chunk_count; i++) {
+            for (int j = 0; j < m_chunk_count; j++) {
+                _chunkAt(i, j)->Submit(queue, time, m_chunk_count,
+                                       glm::translate(_m, glm::vec3(i * CHUNK_SIDE_TILE_COUNT,
+                                                                    0.0, j * CHUNK_SIDE_TILE_COUNT)),
+                                       view);
             }
         }
         if (!onlyTerrain) {
-            for (size_t i = 0; i < m_chunks.size(); i++) {
-                for (size_t j = 0; j < m_chunks.size(); j++) {
-                    m_water_grid.Draw(glm::vec2(i * CHUNK_SIDE_TILE_COUNT, j * CHUNK_SIDE_TILE_COUNT), time / 4.0f,
-                                      glm::translate(glm::scale(_m, glm::vec3(CHUNK_SIDE_TILE_COUNT)),
-                                                     glm::vec3(i, m_water_height, j)), view, projection);
+            packet.draw = &Terrain::_drawWater;
+            packet.object = &m_water_grid;
+            for (int i = 0; i < m_chunk_count; i++) {
+                for (int j = 0; j < m_chunk_count; j++) {
+                    packet.model = glm::translate(glm::scale(_m, glm::vec3(CHUNK_SIDE_TILE_COUNT)),
+                                                  glm::vec3(i, m_water_height, j));
+                    packet.params = glm::vec4(i * CHUNK_SIDE_TILE_COUNT, j * CHUNK_SIDE_TILE_COUNT, 0, 0);
+                    float depth = RenderQueue::ViewDepth(view, packet.model, glm::vec3(0.5f, 0.f, 0.5f));
+                    packet.key = RenderQueue::TransparentKey(RENDER_PASS_WATER, 0, 0, depth);
+                    queue.Submit(packet);
                 }
             }
         }
     }
 
     void Cleanup() {
-        for (size_t i = 0; i < m_chunks.size(); i++) {
-            for (size_t j = 0; j < m_chunks[i].size(); j++) {
-                m_chunks[i][j]->Cleanup();
-                delete m_chunks[i][j];
+        glm::ivec2 offset = glm::ivec2(TERRAIN_OFFSET);
+        for (int i = 0; i < m_chunk_count; i++) {
+            for (int j = 0; j < m_chunk_count; j++) {
+                _destroyChunk(offset + glm::ivec2(i, j));
             }
         }
+        m_chunk_count = 0;
+        m_chunk_cache.Cleanup();
+        m_water_grid.Cleanup();
+        m_skybox->Cleanup();
+        delete m_skybox;
+        m_skybox = NULL;
     }
 
-    void ExpandTerrain(glm::vec3 camera_position) {
-        const uint32_t edge_threshold = 4;
-        glm::vec3 cam_pos = camera_position;
-        cam_pos = -cam_pos;
-        glm::vec3 old = cam_pos;
-        cam_pos /= TERRAIN_SCALE;
-        cam_pos = getChunkPos(cam_pos);
+    /* Moves the window of chunks with the camera. predicted holds positions the camera is
+     * expected to reach soon (same convention as camera_position, see Camera::predictPosition()) :
+     * the window leans towards them so that their chunks are generated before they are needed.
+     * One row per frame, more only when the camera itself is about to leave the terrain.
+     * The lean grows at once, but it only shrinks or turns around once the camera enters
+     * another chunk : stopping or turning back does not regenerate the rows left ahead. */
+    void ExpandTerrain(glm::vec3 camera_position,
+                       const std::vector<glm::vec3> &predicted = std::vector<glm::vec3>()) {
+        PROFILE_SCOPE("Terrain::ExpandTerrain");
+        const int edge_threshold = (m_chunk_count - 2) / 2;
+        glm::vec3 cam_pos = -camera_position / TERRAIN_SCALE;
 
-        if (cam_pos.z < edge_threshold) {
-            _expand(Terrain::Direction::NORTH);
+        /* Largest predicted move along each axis, in chunks. */
+        glm::vec2 lean = glm::vec2(0.f);
+        for (size_t i = 0; i < predicted.size(); i++) {
+            glm::vec3 move = (-predicted[i] / TERRAIN_SCALE - cam_pos) / (float) CHUNK_SIDE_TILE_COUNT;
+            if (std::abs(move.x) > std::abs(lean.x))
+                lean.x = move.x;
+            if (std::abs(move.z) > std::abs(lean.y))
+                lean.y = move.z;
+        }
+        glm::ivec2 wanted = glm::ivec2(lean);
+        glm::ivec2 camera_chunk = glm::ivec2(glm::floor(glm::vec2(cam_pos.x, cam_pos.z) / (float) CHUNK_SIDE_TILE_COUNT));
+        bool crossed = camera_chunk != m_lean_chunk;
+        m_lean_chunk = camera_chunk;
+        for (int axis = 0; axis < 2; axis++) {
+            bool further = wanted[axis] * m_lean[axis] >= 0 && std::abs(wanted[axis]) > std::abs(m_lean[axis]);
+            if (crossed || further)
+                m_lean[axis] = wanted[axis];
         }
-        else if (cam_pos.z > m_chunks[0].size() - 1 - edge_threshold) {
-            _expand(Terrain::Direction::SOUTH);
+        /* Leaves at least one chunk behind the camera. */
+        glm::ivec2 shift = glm::clamp(m_lean, -(edge_threshold - 1), edge_threshold - 1);
+
+        for (int rows = 0; rows < CHUNK_PREFETCH_MAX_ROWS; rows++) {
+            glm::vec3 chunk = getChunkPos(cam_pos);
+            int last_x = m_chunk_count - 1;
+            int last_z = m_chunk_count - 1;
+            bool urgent = chunk.x < 1 || chunk.x > last_x - 1 || chunk.z < 1 || chunk.z > last_z - 1;
+            if (rows > 0 && !urgent)
+                break;
+
+            if (chunk.z < edge_threshold - shift.y) {
+                _expand(Terrain::Direction::NORTH);
+            }
+            else if (chunk.z > last_z - edge_threshold - shift.y) {
+                _expand(Terrain::Direction::SOUTH);
+            }
+            else if (chunk.x < edge_threshold - shift.x) {
+                _expand(Terrain::Direction::WEST);
+            }
+            else if (chunk.x > last_x - edge_threshold - shift.x) {
+                _expand(Terrain::Direction::EST);
+            }
+            else {
+                break;
+            }
         }
-        else if (cam_pos.x < edge_threshold) {
-            _expand(Terrain::Direction::WEST);
+    }
+
+    int getChunkCount() {
+        return m_chunk_count;
+    }
+
+    /* Resizes the terrain to count chunks per side around its current centre. The chunks that
+     * stay are kept, the others go to the cache and from there back to the pool, which is
+     * trimmed when the terrain shrinks. Returns the size actually used, see ClampChunkCount(). */
+    int setChunkCount(int count) {
+        PROFILE_SCOPE("Terrain::setChunkCount");
+        count = ClampChunkCount(count);
+        int old_count = m_chunk_count;
+        if (count == old_count)
+            return count;
+
+        glm::ivec2 old_offset = glm::ivec2(TERRAIN_OFFSET);
+        glm::ivec2 offset = old_offset + glm::ivec2((old_count - count) / 2);
+        /* Released first so that the new chunks reuse their heightmaps. */
+        for (int i = 0; i < old_count; i++) {
+            for (int j = 0; j < old_count; j++) {
+                glm::ivec2 indices = old_offset + glm::ivec2(i, j);
+                glm::ivec2 relative = indices - offset;
+                if (relative.x < 0 || relative.x >= count || relative.y < 0 || relative.y >= count)
+                    _destroyChunk(indices);
+            }
         }
-        else if (cam_pos.x > m_chunks.size() - 1 - edge_threshold) {
-            _expand(Terrain::Direction::EST);
+        for (int i = 0; i < count; i++) {
+            for (int j = 0; j < count; j++) {
+                if (!m_chunks.Get(offset + glm::ivec2(i, j)))
+                    _createChunk(offset + glm::ivec2(i, j));
+            }
         }
+        m_chunk_count = count;
+        TERRAIN_OFFSET = glm::vec2(offset);
+        _applyChunkCount();
+        _fitCacheToBudget();
+        if (count < old_count)
+            FRAMEBUFFER_POOL.Trim();
+        return count;
+    }
+
+    /* Bounds count by TERRAIN_CHUNK_SIZE_MIN/MAX and by the heightmaps that fit in what the other
+     * allocations leave of the GPU memory budget, when one is set. */
+    int ClampChunkCount(int count) {
+        /* TERRAIN_CHUNK_SIZE_MAX is also the capacity of m_chunks. */
+        count = glm::clamp(count, TERRAIN_CHUNK_SIZE_MIN, TERRAIN_CHUNK_SIZE_MAX);
+        size_t budget = GPU_MEMORY.getBudget();
+        size_t chunk_bytes = m_perlin_noise->getHeightmapBytes();
+        if (!budget || !chunk_bytes)
+            return count;
+        size_t others = GPU_MEMORY.getTotalBytes() - GPU_MEMORY.getBytes(GPU_MEMORY_HEIGHTMAPS);
+        size_t available = budget > others ? budget - others : 0;
+        int fit = (int) std::sqrt((double) (available / chunk_bytes));
+        return glm::max(TERRAIN_CHUNK_SIZE_MIN, glm::min(count, fit));
+    }
+
+    void Report(std::ostream &out) {
+        m_chunk_cache.Report(out);
+    }
+
+    /* Distance from the centre of the terrain to its edges, in world units. */
+    float getViewRadius() {
+        return m_chunk_count * CHUNK_SIDE_TILE_COUNT * TERRAIN_SCALE / 2.f;
+    }
+
+    /* The terrain fades out before its edges. */
+    glm::vec2 getFogRange() {
+        return glm::vec2(0.75f, 1.f) * getViewRadius();
+    }
+
+    /* Far enough for the corners of the skybox. */
+    float getFarPlane() {
+        return _skyboxScale() * TERRAIN_SCALE;
     }
 
     float getHeight(glm::vec2 pos) {
@@ -106,29 +244,97 @@ public:
         tmp = getChunkPos(tmp);
         glm::vec2 relative_pos =
                 pos - glm::vec2(TERRAIN_OFFSET.x * CHUNK_SIDE_TILE_COUNT, TERRAIN_OFFSET.y * CHUNK_SIDE_TILE_COUNT);
-        if (relative_pos.x <= 0.f || relative_pos.x >= TERRAIN_CHUNK_SIZE * CHUNK_SIDE_TILE_COUNT ||
-            relative_pos.y <= 0.f || relative_pos.y >= TERRAIN_CHUNK_SIZE * CHUNK_SIDE_TILE_COUNT) {
+        if (relative_pos.x <= 0.f || relative_pos.x >= m_chunk_count * CHUNK_SIDE_TILE_COUNT ||
+            relative_pos.y <= 0.f || relative_pos.y >= m_chunk_count * CHUNK_SIDE_TILE_COUNT) {
             throw std::runtime_error("Out of terrain bounds " + std::to_string(tmp.x) + " " + std::to_string(tmp.y));
         }
 
         glm::vec2 chunk_idx = glm::vec2(tmp.x, tmp.z);
-        FrameBuffer *frameBuffer = m_perlin_noise->getFrameBufferForChunk(chunk_idx);
+        Heightfield &heightfield = _chunkAt((int) chunk_idx.x, (int) chunk_idx.y)->getHeightfield();
+
+        glm::vec2 pos_on_chunk = pos - glm::vec2((chunk_idx.x + TERRAIN_OFFSET.x) * CHUNK_SIDE_TILE_COUNT,
+                                                 (chunk_idx.y + TERRAIN_OFFSET.y) * CHUNK_SIDE_TILE_COUNT);
+        pos_on_chunk /= CHUNK_SIDE_TILE_COUNT;
+
+        return (heightfield.Sample(pos_on_chunk) - 0.5f) * m_amplitude;
+    }
 
-        glm::vec2 pos_on_tex = pos - glm::vec2((chunk_idx.x + TERRAIN_OFFSET.x) * CHUNK_SIDE_TILE_COUNT,
-                                               (chunk_idx.y + TERRAIN_OFFSET.y) * CHUNK_SIDE_TILE_COUNT);
+    /* First intersection of origin + t * direction with the terrain for t in [0, max_distance],
+     * in the same units as getHeight(). Walks the chunks along the ray and lets each
+     * chunk's Heightfield skip the space above its surface. */
+    bool Raycast(glm::vec3 origin, glm::vec3 direction, float max_distance, TerrainHit &hit) {
+        PROFILE_SCOPE("Terrain::Raycast");
+        if (glm::length(direction) <= 0.f || m_amplitude <= 0.f || m_chunk_count == 0)
+            return false;
+        glm::vec3 dir = glm::normalize(direction);
+        const float side = CHUNK_SIDE_TILE_COUNT;
+        glm::vec2 corner = TERRAIN_OFFSET * side;
+        int chunk_count[2] = {m_chunk_count, m_chunk_count};
 
-        pos_on_tex.x /= (CHUNK_SIDE_TILE_COUNT);
-        pos_on_tex.y /= (CHUNK_SIDE_TILE_COUNT);
-        pos_on_tex.x *= frameBuffer->getSize().x;
-        pos_on_tex.y *= frameBuffer->getSize().y;
+        /* Clips the ray to the terrain's square. */
+        float t = 0.f, t_end = max_distance;
+        for (int axis = 0; axis < 2; axis++) {
+            float o = axis == 0 ? origin.x : origin.z;
+            float d = axis == 0 ? dir.x : dir.z;
+            float low = corner[axis], high = corner[axis] + chunk_count[axis] * side;
+            if (std::abs(d) < 1e-12f) {
+                if (o < low || o > high)
+                    return false;
+                continue;
+            }
+            float t0 = (low - o) / d, t1 = (high - o) / d;
+            t = std::max(t, std::min(t0, t1));
+            t_end = std::min(t_end, std::max(t0, t1));
+        }
+        if (t > t_end)
+            return false;
 
-        frameBuffer->Bind();
-        float height;
-        glReadPixels((int) pos_on_tex.x, (int) pos_on_tex.y, 1, 1, GL_RED, GL_FLOAT, &height);
-        frameBuffer->Unbind();
+        /* 2D DDA over the chunks. */
+        glm::vec3 start = origin + t * dir;
+        int cell[2], step[2];
+        float t_next[2], t_delta[2];
+        for (int axis = 0; axis < 2; axis++) {
+            float o = axis == 0 ? start.x : start.z;
+            float d = axis == 0 ? dir.x : dir.z;
+            cell[axis] = glm::clamp((int) std::floor((o - corner[axis]) / side), 0, chunk_count[axis] - 1);
+            step[axis] = d >= 0.f ? 1 : -1;
+            if (std::abs(d) < 1e-12f) {
+                t_next[axis] = t_delta[axis] = INFINITY;
+            } else {
+                float boundary = corner[axis] + (cell[axis] + (d >= 0.f ? 1 : 0)) * side;
+                t_next[axis] = t + (boundary - o) / d;
+                t_delta[axis] = side / std::abs(d);
+            }
+        }
 
-        height = (height - 0.5f) * m_amplitude;
-        return height;
+        while (t <= t_end) {
+            float t_exit = std::min(std::min(t_next[0], t_next[1]), t_end);
+            Chunk *chunk = _chunkAt(cell[0], cell[1]);
+            /* The chunk's frame : x and z in [0, 1], y the raw noise value. */
+            glm::vec3 chunk_corner = glm::vec3(corner.x + cell[0] * side, 0.f, corner.y + cell[1] * side);
+            glm::vec3 scale = glm::vec3(1.f / side, 1.f / m_amplitude, 1.f / side);
+            glm::vec3 local_origin = (origin - chunk_corner) * scale + glm::vec3(0.f, 0.5f, 0.f);
+            float t_hit;
+            if (chunk->getHeightfield().Raycast(local_origin, dir * scale, t, t_exit, t_hit)) {
+                hit.position = origin + t_hit * dir;
+                glm::vec3 local_hit = local_origin + t_hit * dir * scale;
+                glm::vec2 gradient = chunk->getHeightfield().Gradient(glm::vec2(local_hit.x, local_hit.z)) *
+                                     (m_amplitude / side);
+                hit.normal = glm::normalize(glm::vec3(-gradient.x, 1.f, -gradient.y));
+                hit.distance = t_hit;
+                hit.chunk = chunk;
+                return true;
+            }
+            if (t_exit >= t_end)
+                break;
+            int axis = t_next[0] < t_next[1] ? 0 : 1;
+            t = t_next[axis];
+            t_next[axis] += t_delta[axis];
+            cell[axis] += step[axis];
+            if (cell[axis] < 0 || cell[axis] >= chunk_count[axis])
+                break;
+        }
+        return false;
     }
 
     enum Direction {
@@ -140,11 +346,28 @@ private:
     PerlinNoise *m_perlin_noise;
     WaterGrid m_water_grid;
     ChunkFactory m_chunk_factory;
-    std::deque<std::deque<Chunk *>> m_chunks;
+    ChunkGrid m_chunks;
+    ChunkCache m_chunk_cache;
+    /* Chunks per side, the terrain covers TERRAIN_OFFSET to TERRAIN_OFFSET + m_chunk_count. */
+    int m_chunk_count;
     SkyBox *m_skybox;
+    /* Lean of the window towards the predicted motion, in chunks, and the chunk of the camera
+     * when it was last updated, see ExpandTerrain(). */
+    glm::ivec2 m_lean;
+    glm::ivec2 m_lean_chunk;
 
     float m_amplitude;
 
+    static void _drawSkybox(const DrawPacket &packet, const RenderContext &context) {
+        ((SkyBox *) packet.object)->Draw(context.projection * context.view * packet.model);
+    }
+
+    static void _drawWater(const DrawPacket &packet, const RenderContext &context) {
+        ((WaterGrid *) packet.object)->setFogRange(context.fog_range);
+        ((WaterGrid *) packet.object)->Draw(glm::vec2(packet.params.x, packet.params.y), context.time / 4.0f,
+                                            packet.model, context.view, context.projection);
+    }
+
     glm::vec3 getChunkPos(glm::vec3 pos) {
         pos /= CHUNK_SIDE_TILE_COUNT;
         pos -= glm::vec3(TERRAIN_OFFSET.x, 0, TERRAIN_OFFSET.y);
@@ -153,62 +376,79 @@ private:
         return pos;
     }
 
-    void _expand(Direction dir) {
+    /* Side of the skybox in terrain units, it must enclose the terrain. */
+    float _skyboxScale() {
+        return glm::max(100.f, 1.5f * m_chunk_count * CHUNK_SIDE_TILE_COUNT);
+    }
 
-        switch (dir) {
-            case SOUTH: {
-                TERRAIN_OFFSET.y++;
-                m_perlin_noise->setTerrainOffset(TERRAIN_OFFSET);
-                for (int i = 0; i < m_chunks.size(); i++) {
-                    m_chunks[i].pop_front();
-                    /* NOTE : The +1 in the indice y is important to avoid an off-by-one error. */
-                    m_chunks[i].push_back(m_chunk_factory.createChunk(
-                            glm::vec2(TERRAIN_OFFSET.x + i, m_chunks[i].size() - 1 + 1 + TERRAIN_OFFSET.y)));
-                    m_chunks[i][m_chunks[i].size() - 1]->Init();
-                }
-                break;
-            }
+    void _applyChunkCount() {
+        BASE_TILE->setTerrainSize(m_chunk_count);
+        m_chunk_cache.setCapacity(CHUNK_CACHE_ROWS * m_chunk_count);
+        m_skybox->setScale(_skyboxScale());
+    }
 
-            case NORTH: {
-                TERRAIN_OFFSET.y--;
-                m_perlin_noise->setTerrainOffset(TERRAIN_OFFSET);
-                for (int i = 0; i < m_chunks.size(); i++) {
-                    m_chunks[i].pop_back();
-                    m_chunks[i].push_front(m_chunk_factory.createChunk(glm::vec2(
-                            TERRAIN_OFFSET.x + i, TERRAIN_OFFSET.y)));
+    /* i and j relative to TERRAIN_OFFSET, in [0, m_chunk_count). */
+    Chunk *_chunkAt(int i, int j) {
+        return m_chunks.Get(glm::ivec2(TERRAIN_OFFSET) + glm::ivec2(i, j));
+    }
 
-                    m_chunks[i][0]->Init();
-                }
-                break;
-            }
+    /* Generates the chunk, unless it left the terrain recently and is still in the cache. */
+    void _createChunk(glm::ivec2 indices) {
+        Chunk *chunk = m_chunks.Take(indices);
+        m_chunk_factory.placeChunk(*chunk, glm::vec2(indices));
+        CachedChunk cached;
+        chunk->Init(m_chunk_cache.Take(indices, cached) ? &cached : NULL);
+    }
 
-            case WEST: {
-                m_chunks.pop_back();
-                m_chunks.push_front(std::deque<Chunk *>(m_chunks[0].size(), NULL));
-                TERRAIN_OFFSET.x--;
-                m_perlin_noise->setTerrainOffset(TERRAIN_OFFSET);
-                for (int i = 0; i < m_chunks[0].size(); i++) {
-                    m_chunks[0][i] = m_chunk_factory.createChunk(glm::vec2(
-                            TERRAIN_OFFSET.x, i + TERRAIN_OFFSET.y));
+    void _destroyChunk(glm::ivec2 indices) {
+        Chunk *chunk = m_chunks.Get(indices);
+        if (!chunk)
+            return;
+        CachedChunk cached;
+        chunk->Cleanup(&cached);
+        m_chunk_cache.Put(indices, cached);
+        m_chunks.Free(indices);
+    }
 
-                    m_chunks[0][i]->Init();
-                }
-                break;
-            }
+    /* Under a GPU memory budget the cache only keeps what the terrain leaves. reserve is memory
+     * about to be allocated : the heightmaps evicted for it wait in the pool for the new chunks,
+     * without reserve they are freed. */
+    void _fitCacheToBudget(size_t reserve = 0) {
+        size_t budget = GPU_MEMORY.getBudget();
+        if (!budget)
+            return;
+        size_t evicted = 0;
+        while (GPU_MEMORY.getTotalBytes() + reserve > budget + evicted && m_chunk_cache.EvictOne())
+            evicted += m_perlin_noise->getHeightmapBytes();
+        if (evicted && !reserve)
+            FRAMEBUFFER_POOL.Trim();
+    }
 
-            case EST: {
-                m_chunks.pop_front();
-                m_chunks.push_back(std::deque<Chunk *>(m_chunks[0].size(), NULL));
-                TERRAIN_OFFSET.x++;
-                m_perlin_noise->setTerrainOffset(TERRAIN_OFFSET);
-                for (int i = 0; i < m_chunks[0].size(); i++) {
-                    m_chunks[m_chunks.size() - 1][i] = m_chunk_factory.createChunk(
-                            glm::vec2(m_chunks.size() - 1 + TERRAIN_OFFSET.x, i + TERRAIN_OFFSET.y));
-                    m_chunks[m_chunks.size() - 1][i]->Init();
-                }
-                break;
-            }
+    /* Drops the row of chunks on the opposite side and generates one in direction dir. */
+    void _expand(Direction dir) {
+        glm::ivec2 step;
+        switch (dir) {
+            case SOUTH: step = glm::ivec2(0, 1); break;
+            case NORTH: step = glm::ivec2(0, -1); break;
+            case EST: step = glm::ivec2(1, 0); break;
+            case WEST: step = glm::ivec2(-1, 0); break;
         }
+        /* axis selects the row, along walks it. */
+        glm::ivec2 axis = glm::abs(step);
+        glm::ivec2 along = glm::ivec2(1) - axis;
+        int back = step.x + step.y > 0 ? 0 : m_chunk_count - 1;
+        int front = m_chunk_count - 1 - back;
 
+        glm::ivec2 offset = glm::ivec2(TERRAIN_OFFSET);
+        for (int k = 0; k < m_chunk_count; k++) {
+            _destroyChunk(offset + axis * back + along * k);
+        }
+        offset += step;
+        TERRAIN_OFFSET = glm::vec2(offset);
+        _fitCacheToBudget(m_chunk_count * m_perlin_noise->getHeightmapBytes());
+        for (int k = 0; k < m_chunk_count; k++) {
+            _createChunk(offset + axis * front + along * k);
+        }
+        _fitCacheToBudget();
     }
-};
\ No newline at end of file
+};
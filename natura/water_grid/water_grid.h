@@ -2,6 +2,10 @@
 
 #include "icg_helper.h"
 #include <glm/gtc/type_ptr.hpp>
+#include "../misc/profiling/cpu_profiler.h"
+#include "../misc/gl_state/gl_state.h"
+#include "../misc/profiling/gpu_memory.h"
+#include "../misc/shaders/shader_library.h"
 
 class WaterGrid {
 
@@ -15,23 +19,28 @@ private:
     GLuint reflection_texture_id_;          // texture ID
     GLuint num_indices_;                    // number of vertices to render
     GLuint MV_id;                         // model, view, proj matrix ID
+    glm::vec2 fog_range_;
 
 public:
+    void setFogRange(glm::vec2 range) {
+        fog_range_ = range;
+    }
+
     void Init(GLuint water_reflection_tex) {
         reflection_texture_id_ = water_reflection_tex;
 
         // compile the shaders.
-        program_id_ = icg_helper::LoadShaders("water_grid_vshader.glsl",
-                                              "water_grid_fshader.glsl");
+        program_id_ = SHADER_LIBRARY.Get("water_grid_vshader.glsl",
+                                         "water_grid_fshader.glsl");
         if (!program_id_) {
             exit(EXIT_FAILURE);
         }
 
-        glUseProgram(program_id_);
+        GL_STATE.UseProgram(program_id_);
 
         // vertex one vertex array
         glGenVertexArrays(1, &vertex_array_id_);
-        glBindVertexArray(vertex_array_id_);
+        GL_STATE.BindVertexArray(vertex_array_id_);
 
         // vertex coordinates and indices
         {
@@ -69,12 +78,16 @@ public:
             glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_position_);
             glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat),
                          &vertices[0], GL_STATIC_DRAW);
+            GPU_MEMORY.Allocate(GPU_OBJECT_BUFFER, vertex_buffer_object_position_, GPU_MEMORY_GEOMETRY,
+                                vertices.size() * sizeof(GLfloat));
 
             // vertex indices
             glGenBuffers(1, &vertex_buffer_object_index_);
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertex_buffer_object_index_);
             glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
                          &indices[0], GL_STATIC_DRAW);
+            GPU_MEMORY.Allocate(GPU_OBJECT_BUFFER, vertex_buffer_object_index_, GPU_MEMORY_GEOMETRY,
+                                indices.size() * sizeof(GLuint));
 
             // position shader attribute
             GLuint loc_position = glGetAttribLocation(program_id_, "position");
@@ -88,8 +101,10 @@ public:
             const int ColormapSize = 2;
             GLfloat tex[3 * ColormapSize] = {0.0, 0.2, 0.45, 158.0f / 255.0f, 181.0f / 255.0f, 210.0f / 255.0f};
             glGenTextures(1, &texture_id_);
-            glBindTexture(GL_TEXTURE_1D, texture_id_);
+            GL_STATE.BindTexture(GL_TEXTURE_1D, texture_id_);
             glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB, ColormapSize, 0, GL_RGB, GL_FLOAT, tex);
+            GPU_MEMORY.Allocate(GPU_OBJECT_TEXTURE, texture_id_, GPU_MEMORY_MATERIALS,
+                                GpuMemoryTracker::TextureBytes(GL_RGB, ColormapSize, 1));
             glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
             glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -104,7 +119,7 @@ public:
             glUniform1i(tex_mirror_id, 1 /*GL_TEXTURE1*/);
 
             // cleanup
-            glBindTexture(GL_TEXTURE_2D, 0);
+            GL_STATE.BindTexture(GL_TEXTURE_2D, 0);
         }
 
         // other uniforms
@@ -145,36 +160,38 @@ public:
 
 
         // to avoid the current object being polluted
-        glBindVertexArray(0);
-        glUseProgram(0);
+        GL_STATE.BindVertexArray(0);
+        GL_STATE.UseProgram(0);
     }
 
     void Cleanup() {
-        glBindVertexArray(0);
-        glUseProgram(0);
+        GL_STATE.BindVertexArray(0);
+        GL_STATE.UseProgram(0);
+        GPU_MEMORY.Free(GPU_OBJECT_BUFFER, vertex_buffer_object_position_);
+        GPU_MEMORY.Free(GPU_OBJECT_BUFFER, vertex_buffer_object_index_);
         glDeleteBuffers(1, &vertex_buffer_object_position_);
         glDeleteBuffers(1, &vertex_buffer_object_index_);
-        glDeleteVertexArrays(1, &vertex_array_id_);
-        glDeleteProgram(program_id_);
-        glDeleteTextures(1, &texture_id_);
+        GL_STATE.DeleteVertexArrays(1, &vertex_array_id_);
+        SHADER_LIBRARY.Release(program_id_);
+        GPU_MEMORY.Free(GPU_OBJECT_TEXTURE, texture_id_);
+        GPU_MEMORY.Free(GPU_OBJECT_TEXTURE, texture_water_id_);
+        GL_STATE.DeleteTextures(1, &texture_id_);
+        GL_STATE.DeleteTextures(1, &texture_water_id_);
     }
 
     void Draw(glm::vec2 pos, float time, const glm::mat4 &model = IDENTITY_MATRIX,
               const glm::mat4 &view = IDENTITY_MATRIX,
               const glm::mat4 &projection = IDENTITY_MATRIX) {
-        glUseProgram(program_id_);
-        glBindVertexArray(vertex_array_id_);
+        GL_STATE.UseProgram(program_id_);
+        GL_STATE.BindVertexArray(vertex_array_id_);
 
         // bind textures
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture_id_);
+        GL_STATE.BindTexture(GL_TEXTURE0, GL_TEXTURE_2D, texture_id_);
 
         // bind textures
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, reflection_texture_id_);
+        GL_STATE.BindTexture(GL_TEXTURE1, GL_TEXTURE_2D, reflection_texture_id_);
 
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, texture_water_id_);
+        GL_STATE.BindTexture(GL_TEXTURE2, GL_TEXTURE_2D, texture_water_id_);
 
         // setup MV
         glm::mat4 MV = view * model;
@@ -185,23 +202,20 @@ public:
         // pass the current time stamp to the shader.
         glUniform1f(glGetUniformLocation(program_id_, "time"), time);
         glUniform2fv(glGetUniformLocation(program_id_, "chunk_pos"), ONE, glm::value_ptr(pos));
+        glUniform2fv(glGetUniformLocation(program_id_, "fog_range"), ONE, glm::value_ptr(fog_range_));
 
 
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        GL_STATE.Enable(GL_BLEND);
+        GL_STATE.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
         glDrawElements(GL_TRIANGLE_STRIP, num_indices_, GL_UNSIGNED_INT, 0);
         //glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-        glDisable(GL_BLEND);
-
-        glBindVertexArray(0);
-        glUseProgram(0);
     }
 
 
     void loadTexture(string filename, GLuint *texture_id, int tex_index, GLint tex_id_uniform) {
+        PROFILE_SCOPE("WaterGrid::loadTexture");
         // load grass texture
         int width;
         int height;
@@ -216,7 +230,7 @@ public:
         }
 
         glGenTextures(1, texture_id);
-        glBindTexture(GL_TEXTURE_2D, *texture_id);
+        GL_STATE.BindTexture(GL_TEXTURE_2D, *texture_id);
 
         if (nb_component == 3) {
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0,
@@ -229,11 +243,13 @@ public:
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glGenerateMipmap(GL_TEXTURE_2D);
+        GPU_MEMORY.Allocate(GPU_OBJECT_TEXTURE, *texture_id, GPU_MEMORY_MATERIALS,
+                            GpuMemoryTracker::TextureBytes(GL_RGBA, width, height, true));
 
         glUniform1i(tex_id_uniform, tex_index /*GL_TEXTURE*/);
 
         // cleanup
         stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        GL_STATE.BindTexture(GL_TEXTURE_2D, 0);
     }
 };
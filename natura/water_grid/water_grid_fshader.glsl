@@ -1,6 +1,4 @@
 #version 330
-#define min_fog_distance 30.0f
-#define max_fog_distance 40.0f
 #define noise_factor 0.1f
 
 in vec2 uv;
@@ -11,6 +9,7 @@ in vec3 view_dir;
 in vec3 normal;
 in float distance_camera;
 
+uniform vec2 fog_range;  // start and end of the fog
 uniform vec3 La, Ld, Ls;
 uniform vec3 ka, kd, ks;
 uniform float alpha;
@@ -55,7 +54,7 @@ void main() {
     vec2 new_uv = vec2(width_normed, 1 - height_normed);
     vec3 color_from_mirror = texture(tex_reflection, new_uv + noise_factor * normal_normalized.xz).rgb;
 
-    float fog_factor = (max_fog_distance - distance_camera) / (max_fog_distance - min_fog_distance);
+    float fog_factor = (fog_range.y - distance_camera) / (fog_range.y - fog_range.x);
     fog_factor = clamp(fog_factor, 0.0f, 1.0f);
 
     vec3 original_color = specular + diffuse + ambient;